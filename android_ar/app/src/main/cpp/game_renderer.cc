@@ -216,10 +216,10 @@ void GameRenderer::update(const Game& game, float game_scale) {
 
   std::vector< std::vector<Block> > blocks_by_material(nMaterials);
 
-  for (Block block : game.getAllBlocks()) {
+  game.forEachBlock([&blocks_by_material, nMaterials](const Block& block) {
     const int materialId = block.pieceId % nMaterials;
     blocks_by_material[materialId].push_back(block);
-  }
+  });
 
   for (int i = 0; i < nMaterials; ++i) {
     scene_by_material_[i] = blocksToModel(blocks_by_material[i], game.getDimensions(), game_scale);
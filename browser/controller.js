@@ -13,28 +13,26 @@ class GameController {
         }
     }
 
-    nextFrame(dtMilliseconds) {
-        if (this.game.tick(dtMilliseconds))
+    advanceTo(timeMilliseconds) {
+        if (this.game.advanceTo(timeMilliseconds))
             this.notifyChanged();
     }
 
     run() {
-        let prevTime;
+        const startTime = window.performance.now();
         const that = this;
 
-        function animationStep(timestamp) {
-            if (!prevTime) prevTime = timestamp;
-            const dt = timestamp - prevTime;
-
-            that.nextFrame(dt);
+        // the game has nothing to do between its timed events (controls
+        // are handled separately) so sleep until the next one is due
+        function timedStep() {
+            that.advanceTo(Math.floor(window.performance.now() - startTime));
 
             if (!that.game.isOver()) {
-                window.requestAnimationFrame(animationStep);
+                window.setTimeout(timedStep, that.game.msUntilNextEvent());
             }
-            prevTime = timestamp;
         }
 
-        window.requestAnimationFrame(animationStep);
+        window.setTimeout(timedStep, this.game.msUntilNextEvent());
     }
 
     onKeyDown(e) {
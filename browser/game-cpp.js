@@ -16,7 +16,13 @@ class Game {
             'isOver',
             'getScore',
             'getDimensions',
+            'getActiveVersion',
+            'getCementedVersion',
             'tick',
+            'getTimeMs',
+            'advanceTo',
+            'msUntilNextEvent',
+            'advanceToNextEvent',
             'moveXY',
             'drop',
             'delete' // emscripten
@@ -45,6 +51,10 @@ class Game {
     getAllBlocks() {
         return Game._vectorToJsArray(this._game.getAllBlocks());
     }
+
+    forEachBlock(callback) {
+        this._game.forEachBlock(callback);
+    }
 }
 
 Game._vectorToJsArray = function (vec) {
@@ -97,9 +97,9 @@ function gameRenderer(game) {
     return function() {
         $("#score").text(game.getScore());
 
-        let blocks = game.getAllBlocks();
+        const meshes = [];
 
-        const meshes = blocks.map(block => {
+        game.forEachBlock(block => {
             var material = blockMaterials[block.pieceId % N_BLOCK_MATERIALS];
             if (game.isOver() && false) {
                 material = materials.lost;
@@ -112,7 +112,7 @@ function gameRenderer(game) {
             mesh.translateZ((block.pos.y - h*0.5 + 0.5)*boxSz);
             mesh.translateY((block.pos.z+0.5)*boxSz - centerZ);
 
-            return mesh;
+            meshes.push(mesh);
         });
 
         // add plane
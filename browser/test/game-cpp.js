@@ -30,6 +30,13 @@ QUnit.test( "game basics", function( assert ) {
     assert.equal( game.getActiveBlocks().length, 4 );
     assert.equal( game.getCementedBlocks().length, 8 );
     assert.equal( game.getAllBlocks().length, 12 );
+
+    let nVisited = 0;
+    game.forEachBlock(block => {
+        assert.ok( block.pos.z >= 0 );
+        nVisited++;
+    });
+    assert.equal( nVisited, 12 );
     game.delete();
 
     const anotherGame = new Game(1);
@@ -37,3 +44,24 @@ QUnit.test( "game basics", function( assert ) {
     assert.equal( anotherGame.getScore(), 0 );
     anotherGame.delete();
 });
+
+QUnit.test( "golden piece sequence", function( assert ) {
+    // same as in cpp/test/testsuite.cpp
+    const game = new Game(2024);
+    let nPieces = 0;
+    let checksum = 0;
+    while (!game.isOver()) {
+        game.getActiveBlocks().forEach(b => {
+            checksum = (checksum*31 + b.pos.x + 8*b.pos.y + 64*b.pos.z) % 1000000007;
+        });
+        game.moveXY(nPieces % 2 ? 1 : -1, 0);
+        game.moveXY(0, nPieces % 3 ? 1 : -1);
+        game.rotate('Y', 'CW');
+        game.drop();
+        nPieces++;
+    }
+    assert.equal( nPieces, 21 );
+    assert.equal( game.getScore(), 131 );
+    assert.equal( checksum, 755300241 );
+    game.delete();
+});
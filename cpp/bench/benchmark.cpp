@@ -0,0 +1,364 @@
+#include "game.hpp"
+#include "game-batch.hpp"
+#include "placement-generator.hpp"
+#include "board-features.hpp"
+#include "autoplayer.hpp"
+#include "expectimax.hpp"
+#include "mcts-search.hpp"
+#include "transposition-table.hpp"
+#include "value-network.hpp"
+#include "xoshiro.hpp"
+#include "piece-shapes.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+
+// Micro-benchmarks of the game engine. Run all with ./bin/benchmark or
+// only those whose name starts with the given prefix: ./bin/benchmark fits
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    double secondsSince(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // calls the function, which returns the number of operations it
+    // performed, until at least MIN_SECONDS have passed
+    template <class F>
+    void measure(const char *name, const char *unit, F f) {
+        const double MIN_SECONDS = 0.5;
+        const auto start = Clock::now();
+        double nOps = 0;
+        do {
+            nOps += f();
+        } while (secondsSince(start) < MIN_SECONDS);
+        std::printf("%-40s %12.0f %s/s\n", name, nOps / secondsSince(start), unit);
+    }
+
+    // random inputs and drops until the game is over, returns pieces dropped
+    long playRandomGame(Game &game, unsigned int seed) {
+        std::mt19937 inputs(seed);
+        long nPieces = 0;
+        while (!game.isOver()) {
+            for (int i = 0; i < 3; ++i) {
+                switch (inputs() % 4) {
+                case 0: game.moveXY(1, 0); break;
+                case 1: game.moveXY(0, -1); break;
+                case 2: game.rotate(Axis::Z, RotationDirection::CW); break;
+                default: game.rotate(Axis::X, RotationDirection::CCW); break;
+                }
+            }
+            game.drop();
+            nPieces++;
+        }
+        return nPieces;
+    }
+
+    long randomGames() {
+        static unsigned int seed = 0;
+        long nPieces = 0;
+        for (int i = 0; i < 100; ++i) {
+            ConcreteGame game(seed++);
+            nPieces += playRandomGame(game, seed);
+        }
+        return nPieces;
+    }
+
+    long pieceFitsSweep() {
+        const GameBox box(Pos3d { 5, 4, 14 });
+        static CementedBlockArray blocks(box);
+        static bool initialized = false;
+        if (!initialized) {
+            std::mt19937 rng(0);
+            for (int z = 0; z < 6; ++z)
+                for (int y = 0; y < 4; ++y)
+                    for (int x = 0; x < 5; ++x)
+                        if (rng() % 3 != 0) blocks.setBlock(Block { Pos3d { x, y, z }, 1 });
+            initialized = true;
+        }
+
+        long nFits = 0, nCalls = 0;
+        for (int shape = 0; shape < piece_shapes::TABLE.size; ++shape) {
+            for (int z = 0; z < 14; ++z) {
+                for (int y = 0; y < 4; ++y) {
+                    for (int x = 0; x < 5; ++x) {
+                        if (blocks.pieceFits(Piece(Pos3d { x, y, z }, shape, 0))) nFits++;
+                        nCalls++;
+                    }
+                }
+            }
+        }
+        // keep the result alive
+        if (nFits < 0) std::printf("%ld\n", nFits);
+        return nCalls;
+    }
+
+    long snapshots() {
+        static ConcreteGame game(1);
+        static GameState state;
+        for (int i = 0; i < 10; ++i) game.drop();
+        for (int i = 0; i < 1000; ++i) game.snapshot(state);
+        if (game.isOver()) game.restore(state);
+        return 1000;
+    }
+
+    long restores() {
+        static ConcreteGame game(1);
+        static GameState state;
+        static bool initialized = false;
+        if (!initialized) {
+            for (int i = 0; i < 10; ++i) game.drop();
+            game.snapshot(state);
+            initialized = true;
+        }
+        for (int i = 0; i < 1000; ++i) game.restore(state);
+        return 1000;
+    }
+
+    // random actions and FRAME_MS frames for a batch of games in lockstep,
+    // games that are over are restarted. Frames longer than the drop
+    // interval take several gravity steps per tick
+    const int BATCH_SIZE = 1024;
+
+    std::vector<GameBatch::Action> randomActions(std::mt19937 &rng) {
+        std::vector<GameBatch::Action> actions(BATCH_SIZE);
+        for (auto &a : actions) a = static_cast<GameBatch::Action>(rng() % 12);
+        return actions;
+    }
+
+    template <int FRAME_MS>
+    long batchSteps() {
+        static std::vector<unsigned int> seeds(BATCH_SIZE, 0);
+        static GameState fresh;
+        static bool initialized = false;
+        if (!initialized) {
+            for (int i = 0; i < BATCH_SIZE; ++i) seeds[i] = i;
+            ConcreteGame(0).snapshot(fresh);
+            initialized = true;
+        }
+        static GameBatch batch(seeds, Pos3d { 5, 4, 14 });
+        static std::mt19937 rng(0);
+        const std::vector<GameBatch::Action> actions = randomActions(rng);
+
+        for (int i = 0; i < 10; ++i) {
+            batch.step(actions, FRAME_MS);
+            for (int game = 0; game < BATCH_SIZE; ++game)
+                if (batch.isOver(game)) batch.restore(game, fresh);
+        }
+        return 10 * BATCH_SIZE;
+    }
+
+    template <int FRAME_MS>
+    long concreteSteps() {
+        static std::vector< std::unique_ptr<ConcreteGame> > games;
+        static std::mt19937 rng(0);
+        if (games.empty()) {
+            for (int i = 0; i < BATCH_SIZE; ++i) games.emplace_back(new ConcreteGame(i));
+        }
+        const std::vector<GameBatch::Action> actions = randomActions(rng);
+
+        for (int i = 0; i < 10; ++i) {
+            for (int game = 0; game < BATCH_SIZE; ++game) {
+                Game &g = *games[game];
+                const int action = static_cast<int>(actions[game]);
+                if (action >= 1 && action <= 4) {
+                    g.moveXY(action == 1 ? 1 : action == 2 ? -1 : 0, action == 3 ? 1 : action == 4 ? -1 : 0);
+                } else if (action >= 5 && action <= 10) {
+                    g.rotate(static_cast<Axis>((action - 5) / 2),
+                        (action - 5) % 2 == 0 ? RotationDirection::CW : RotationDirection::CCW);
+                } else if (action == 11) {
+                    g.drop();
+                }
+                g.tick(FRAME_MS);
+                if (g.isOver()) games[game].reset(new ConcreteGame(game));
+            }
+        }
+        return 10 * BATCH_SIZE;
+    }
+
+    // states after a few random moves and drops in different games
+    std::vector<GameState> randomBoards(int n) {
+        std::vector<GameState> states(n);
+        std::mt19937 rng(0);
+        for (int i = 0; i < n; ++i) {
+            ConcreteGame game(i);
+            game.snapshot(states[i]);
+            const int nDrops = 3 + rng() % 8;
+            for (int d = 0; d < nDrops; ++d) {
+                game.moveXY(rng() % 2 == 0 ? 1 : -1, 0);
+                game.moveXY(0, rng() % 2 == 0 ? 1 : -1);
+                game.rotate(static_cast<Axis>(rng() % 3), RotationDirection::CW);
+                game.drop();
+                // keep the last state that is not over
+                if (game.isOver()) break;
+                game.snapshot(states[i]);
+            }
+        }
+        return states;
+    }
+
+    long placements() {
+        static const std::vector<GameState> boards = randomBoards(64);
+        static PlacementGenerator generator(Pos3d { 5, 4, 14 });
+        long nPlacements = 0;
+        for (const GameState &board : boards) nPlacements += generator.generate(board).size();
+        return nPlacements;
+    }
+
+    template <BoardFeatureExtractor::Simd SIMD>
+    long boardFeatures() {
+        const int N_BOARDS = 1024;
+        static std::vector<uint64_t> layers;
+        static std::vector<BoardFeatures> out(N_BOARDS);
+        if (layers.empty()) {
+            for (const GameState &board : randomBoards(N_BOARDS))
+                layers.insert(layers.end(), board.layers, board.layers + 14);
+        }
+        // reported as 0 boards/s if not supported by this CPU
+        if (SIMD > BoardFeatureExtractor::bestSimd()) return 0;
+        static const BoardFeatureExtractor extractor(Pos3d { 5, 4, 14 }, SIMD);
+        extractor.computeBatch(layers.data(), N_BOARDS, out.data());
+        return N_BOARDS;
+    }
+
+    // autoplayer moves on a continuing game, restarted when over
+    template <int BEAM_WIDTH, int LOOKAHEAD>
+    long autoplayerMoves() {
+        static WorkStealingPool pool;
+        static Autoplayer player(Pos3d { 5, 4, 14 }, pool, BEAM_WIDTH, LOOKAHEAD);
+        static unsigned int seed = 0;
+        static std::unique_ptr<ConcreteGame> game(new ConcreteGame(seed));
+        for (int i = 0; i < 20; ++i) {
+            if (!player.play(*game)) game.reset(new ConcreteGame(++seed));
+        }
+        return 20;
+    }
+
+    // expectimax searches on the random boards
+    template <int DEPTH, int CANDIDATES>
+    long expectimaxNodes() {
+        static const std::vector<GameState> boards = randomBoards(16);
+        static WorkStealingPool pool;
+        static ExpectimaxSearch search(Pos3d { 5, 4, 14 }, pool, DEPTH, CANDIDATES);
+        static std::size_t next = 0;
+        return search.search(boards[next++ % boards.size()]).nNodes;
+    }
+
+    // MCTS searches of 500 playouts on the random boards
+    long mctsPlayouts() {
+        static const std::vector<GameState> boards = randomBoards(16);
+        static WorkStealingPool pool;
+        static MctsSearch search(Pos3d { 5, 4, 14 }, pool);
+        static std::size_t next = 0;
+        return search.search(boards[next++ % boards.size()], 500).nPlayouts;
+    }
+
+    // lookups, and stores after misses, of random keys in a table that
+    // holds about half of them
+    long transpositionProbes() {
+        struct Value { double value, score; };
+        static TranspositionTable<Value> table(1 << 16);
+        static Xoshiro128 random(1);
+        const int N = 100000;
+        for (int i = 0; i < N; ++i) {
+            const uint64_t key = random.nextBelow(1 << 17) * 0x9e3779b97f4a7c15ull;
+            Value v;
+            if (!table.find(key, v)) table.store(key, Value { 1.0, 2.0 });
+        }
+        return N;
+    }
+
+    // a network of random weights, written to a temporary file and mapped
+    const ValueNetwork &randomNetwork(ValueNetwork::Simd simd) {
+        static ValueNetwork scalar(ValueNetwork::Simd::SCALAR), avx2(ValueNetwork::Simd::AVX2);
+        ValueNetwork &network = simd == ValueNetwork::Simd::SCALAR ? scalar : avx2;
+        if (network.isLoaded()) return network;
+
+        ValueNetwork::Weights w;
+        w.dimensions = Pos3d { 5, 4, 14 };
+        w.nHidden1 = 64;
+        w.nHidden2 = 32;
+        const int nInputs = 5 * 4 * 14 + 5 * 4;
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> uniform(-0.1f, 0.1f);
+        for (int i = 0; i < w.nHidden1 * nInputs; ++i) w.w1.push_back(static_cast<int8_t>(rng() % 255 - 127));
+        for (int i = 0; i < w.nHidden1; ++i) {
+            w.scale1.push_back(0.001f);
+            w.bias1.push_back(uniform(rng));
+        }
+        for (int i = 0; i < w.nHidden2 * w.nHidden1; ++i) w.w2.push_back(uniform(rng));
+        for (int i = 0; i < w.nHidden2; ++i) {
+            w.bias2.push_back(uniform(rng));
+            w.w3.push_back(uniform(rng));
+        }
+        w.bias3 = 0;
+
+        char path[] = "/tmp/3dtris-benchmark-XXXXXX";
+        const int fd = mkstemp(path);
+        if (fd < 0) return network;
+        close(fd);
+        if (ValueNetwork::write(path, w)) network.load(path);
+        unlink(path);
+        return network;
+    }
+
+    template <ValueNetwork::Simd SIMD>
+    long networkEvaluations() {
+        const int N_BOARDS = 1024;
+        static std::vector<uint64_t> layers;
+        static std::vector<float> values(N_BOARDS);
+        if (layers.empty()) {
+            for (const GameState &board : randomBoards(N_BOARDS))
+                layers.insert(layers.end(), board.layers, board.layers + 14);
+        }
+        // reported as 0 boards/s if not supported by this CPU
+        if (SIMD > ValueNetwork::bestSimd()) return 0;
+        const ValueNetwork &network = randomNetwork(SIMD);
+        if (!network.isLoaded()) return 0;
+        network.evaluateBatch(layers.data(), N_BOARDS, values.data());
+        return N_BOARDS;
+    }
+
+    struct Benchmark {
+        const char *name;
+        const char *unit;
+        long (*run)();
+    };
+
+    const Benchmark BENCHMARKS[] = {
+        { "games/random", "pieces", &randomGames },
+        { "fits/sweep", "calls", &pieceFitsSweep },
+        { "snapshot/game", "snapshots", &snapshots },
+        { "restore/game", "restores", &restores },
+        { "batch/game-batch", "game-steps", &batchSteps<100> },
+        { "batch/concrete-games", "game-steps", &concreteSteps<100> },
+        { "batch/game-batch-3s-frames", "game-steps", &batchSteps<3000> },
+        { "batch/concrete-games-3s-frames", "game-steps", &concreteSteps<3000> },
+        { "placements/random-boards", "placements", &placements },
+        { "features/scalar", "boards", &boardFeatures<BoardFeatureExtractor::Simd::SCALAR> },
+        { "features/sse41", "boards", &boardFeatures<BoardFeatureExtractor::Simd::SSE41> },
+        { "features/avx2", "boards", &boardFeatures<BoardFeatureExtractor::Simd::AVX2> },
+        { "autoplayer/greedy", "moves", &autoplayerMoves<1, 0> },
+        { "autoplayer/beam-8-lookahead-1", "moves", &autoplayerMoves<8, 1> },
+        { "autoplayer/beam-16-lookahead-2", "moves", &autoplayerMoves<16, 2> },
+        { "expectimax/depth-1", "nodes", &expectimaxNodes<1, 8> },
+        { "expectimax/depth-2", "nodes", &expectimaxNodes<2, 4> },
+        { "mcts/playouts", "playouts", &mctsPlayouts },
+        { "transposition/probes", "probes", &transpositionProbes },
+        { "network/scalar", "boards", &networkEvaluations<ValueNetwork::Simd::SCALAR> },
+        { "network/avx2", "boards", &networkEvaluations<ValueNetwork::Simd::AVX2> },
+    };
+}
+
+int main(int argc, char **argv) {
+    const char *prefix = argc > 1 ? argv[1] : "";
+    std::printf("sizeof(GameState) = %u bytes\n", static_cast<unsigned>(sizeof(GameState)));
+    for (const Benchmark &b : BENCHMARKS) {
+        if (std::strncmp(b.name, prefix, std::strlen(prefix)) == 0)
+            measure(b.name, b.unit, b.run);
+    }
+    return 0;
+}
@@ -2,6 +2,8 @@
 #define __GAME_HPP__
 #include <vector>
 #include <memory>
+#include <functional>
+#include <cstdint>
 
 struct Pos3d {
     int x, y, z;
@@ -20,18 +22,99 @@ enum class RotationDirection {
     CW, CCW
 };
 
+typedef std::function<void(const Block&)> BlockCallback;
+
+enum class ChangeType {
+    // a cemented block was added
+    BLOCK_SET,
+    // the layer block.pos.z was removed and the layers above it moved down
+    LAYER_REMOVED
+};
+
+struct CementedChange {
+    // cemented version after this change
+    unsigned int version;
+    ChangeType type;
+    Block block;
+};
+
+// Complete state of a game in a fixed-size, trivially copyable struct.
+// Cells are stored in x-major order, z*dims.x*dims.y + y*dims.x + x
+struct GameState {
+    static const int MAX_HEIGHT = 32;
+    static const int MAX_CELLS = 1024;
+
+    // the layers fit in 64-bit masks and the cells in this struct
+    static bool isSupported(Pos3d d) {
+        return d.x > 0 && d.y > 0 && d.z > 0 && d.x <= 64 && d.y <= 64 && d.x*d.y <= 64 &&
+            d.z <= MAX_HEIGHT && d.x*d.y*d.z <= MAX_CELLS;
+    }
+
+    Pos3d dimensions;
+    // bit y*dims.x + x of layers[z] is set if the cell has a block
+    uint64_t layers[MAX_HEIGHT];
+    int pieceIds[MAX_CELLS];
+
+    int activeShape;
+    Pos3d activeCenter;
+    int activePieceId;
+
+    int score;
+    bool alive;
+    int timeMs;
+    int timeToNextDownMs;
+    int nDroppedPieces;
+
+    // see Xoshiro128
+    uint32_t randomState[4];
+    int nextPieceId;
+};
+
 class Game {
 public:
     virtual std::vector<Block> getActiveBlocks() const = 0;
     virtual std::vector<Block> getCementedBlocks() const = 0;
     virtual std::vector<Block> getAllBlocks() const = 0;
 
+    // visit blocks without building intermediate vectors
+    virtual void forEachActiveBlock(const BlockCallback& callback) const = 0;
+    virtual void forEachCementedBlock(const BlockCallback& callback) const = 0;
+    virtual void forEachBlock(const BlockCallback& callback) const = 0;
+
     virtual bool isOver() const = 0;
     virtual int getScore() const = 0;
     virtual Pos3d getDimensions() const = 0;
 
-    // timed events
+    // monotonic counters, incremented whenever the active piece or
+    // the cemented blocks change, respectively
+    virtual unsigned int getActiveVersion() const = 0;
+    virtual unsigned int getCementedVersion() const = 0;
+
+    // append the cemented block changes after the given version to the
+    // output, in order. Returns false if the version is too old, in which
+    // case the blocks must be re-read with getCementedBlocks()
+    virtual bool getCementedChangesSince(unsigned int version,
+        std::vector<CementedChange> &changes) const = 0;
+
+    // save the state into the given struct or restore it from one created
+    // by a game with the same dimensions. Neither allocates memory
+    virtual void snapshot(GameState &state) const = 0;
+    virtual void restore(const GameState &state) = 0;
+
+    // timed events. Returns true if the active piece moved down or was
+    // cemented. Any number of drop intervals can pass in one call
     virtual bool tick(int dtMilliseconds) = 0;
+    // game time, i.e., the sum of all ticks so far. Stops when the game
+    // ends and saturates at INT_MAX (about 24.8 days)
+    virtual int getTimeMs() const = 0;
+    // same as tick(timeMs - getTimeMs()) but the cost does not depend
+    // on the length of the time span, only on the number of pieces cemented
+    virtual bool advanceTo(int timeMs) = 0;
+    // time until the next timed event (the active piece moving down or
+    // being cemented) if there are no inputs, -1 if the game is over
+    virtual int msUntilNextEvent() const = 0;
+    // advance the game time to the next timed event
+    virtual bool advanceToNextEvent() = 0;
 
     // controls
     virtual bool moveXY(int dx, int dy) = 0;
@@ -43,5 +126,6 @@ public:
 };
 
 std::unique_ptr<Game> buildGame(unsigned int randomSeed);
+std::unique_ptr<Game> buildGame(unsigned int randomSeed, Pos3d dimensions);
 
 #endif
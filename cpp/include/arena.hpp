@@ -0,0 +1,53 @@
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for objects that live until the next reset, e.g., the
+// nodes of one search. Nothing is freed individually and no destructors
+// are run, so only trivially destructible types can be created. Not thread
+// safe: use one arena per thread
+class Arena {
+public:
+    explicit Arena(std::size_t chunkSize = 1 << 20);
+
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+
+    void *allocate(std::size_t size, std::size_t alignment);
+
+    template <class T, class... Args>
+    T *create(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <class T>
+    T *createArray(std::size_t n) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        T *array = static_cast<T*>(allocate(sizeof(T)*n, alignof(T)));
+        for (std::size_t i = 0; i < n; ++i) new (array + i) T();
+        return array;
+    }
+
+    // forget all objects, keeps the memory for reuse
+    void reset();
+
+    // bytes handed out since the last reset
+    std::size_t getUsedBytes() const { return used; }
+
+private:
+    const std::size_t chunkSize;
+    std::vector< std::unique_ptr<char[]> > chunks;
+    std::vector<std::size_t> chunkSizes;
+    std::size_t current;
+    std::size_t offset;
+    std::size_t used;
+};
+
+#endif
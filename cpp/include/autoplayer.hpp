@@ -0,0 +1,98 @@
+#ifndef __AUTOPLAYER_HPP__
+#define __AUTOPLAYER_HPP__
+
+#include "api.hpp"
+#include "board-features.hpp"
+#include "game-box.hpp"
+#include "piece-generator.hpp"
+#include "placement-generator.hpp"
+#include "work-stealing-pool.hpp"
+#include <memory>
+#include <vector>
+
+// Plays the game by beam search over placement sequences. The active piece
+// and the next lookahead pieces are placed in turn, keeping the beamWidth
+// best boards of each depth by the linear FeatureWeights evaluation plus the
+// layers removed on the way. The upcoming pieces are known exactly because
+// the piece sequence only depends on the state of the piece generator.
+//
+// The children of the beam boards are expanded and evaluated in batches as
+// tasks in the pool. Each depth that completes within the time budget
+// replaces the previous result, so a search cut short still returns the best
+// move of the deepest completed depth. One search at a time per Autoplayer
+class Autoplayer {
+public:
+    Autoplayer(Pos3d dimensions, WorkStealingPool &pool, int beamWidth = 8, int lookahead = 1);
+
+    Autoplayer(const Autoplayer&) = delete;
+    Autoplayer &operator=(const Autoplayer&) = delete;
+
+    void setWeights(const FeatureWeights &w) { weights = w; }
+    const FeatureWeights &getWeights() const { return weights; }
+
+    // finds the inputs that place the active piece of the state, ending with
+    // DROP. Returns false if the game is over. budgetMs <= 0 means no limit
+    bool chooseInputs(const GameState &state, int budgetMs, std::vector<PlacementInput> &inputs);
+
+    // snapshot, choose and apply the inputs, returns false if the game is over
+    bool play(Game &game, int budgetMs = 0);
+
+    // placement depth reached by the last search, 1 if only the active
+    // piece was placed
+    int getLastDepth() const { return lastDepth; }
+    // boards evaluated by the last search
+    long getLastEvaluatedCount() const { return lastEvaluated; }
+
+private:
+    // a board of the beam, stored separately at the same index
+    struct Node {
+        // placement of the active piece this board descends from
+        int rootPlacement;
+        int nRemovedLayers;
+        // the next piece does not fit, the game would end
+        bool over;
+        double value;
+    };
+
+    // per-thread scratch, indexed by the pool worker index
+    struct Context {
+        PlacementGenerator generator;
+        BoardFeatureExtractor extractor;
+        std::unique_ptr<GameState> state;
+        std::vector<int> nRemoved;
+        std::vector<BoardFeatures> features;
+
+        explicit Context(Pos3d dims);
+    };
+
+    const GameBox gameBox;
+    WorkStealingPool &pool;
+    const int beamWidth;
+    const int lookahead;
+    FeatureWeights weights;
+
+    // the pool workers and one for the thread that calls chooseInputs if
+    // it is not a worker. TaskGroup::wait only runs the tasks of its own
+    // group, so no other thread outside the pool runs the tasks of a search
+    std::vector< std::unique_ptr<Context> > contexts;
+    std::thread::id searchThread;
+    // the root placements, kept for getInputs
+    Context rootContext;
+    PieceGenerator pieceGenerator;
+    std::unique_ptr<GameState> state;
+    std::vector<PlacementInput> inputs;
+
+    int lastDepth;
+    long lastEvaluated;
+
+    Context &localContext();
+    // appends the children of the board, where the piece is placed and then
+    // the next one spawns, and their boards
+    void expand(Context &context, const uint64_t *board, const Node &parent,
+        const Piece &piece, const Piece &next,
+        std::vector<Node> &children, std::vector<uint64_t> &childBoards);
+    // keeps the beamWidth best nodes and their boards
+    void selectBeam(std::vector<Node> &nodes, std::vector<uint64_t> &boards) const;
+};
+
+#endif
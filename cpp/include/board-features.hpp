@@ -0,0 +1,79 @@
+#ifndef __BOARD_FEATURES_HPP__
+#define __BOARD_FEATURES_HPP__
+
+#include "api.hpp"
+#include <cstdint>
+
+// Heuristic features of the cemented blocks for evaluating boards
+struct BoardFeatures {
+    int nBlocks;
+    // empty cells with a block somewhere above them in the same column
+    int holes;
+    // sum and maximum of the column heights (z of the topmost block + 1)
+    int aggregateHeight;
+    int maxHeight;
+    // sum of the absolute height differences of neighboring columns
+    int bumpiness;
+    // how much lower each column is than the lowest of its neighbors,
+    // with the walls as full-height neighbors, summed and the maximum
+    int wellDepth;
+    int maxWellDepth;
+    int fullLayers;
+    // layers with only one or two empty cells
+    int nearFullLayers;
+};
+
+// linear evaluation of a board, higher is better
+struct FeatureWeights {
+    double holes = -4.0;
+    double aggregateHeight = -0.3;
+    double maxHeight = -0.5;
+    double bumpiness = -0.2;
+    double wellDepth = -0.2;
+    double maxWellDepth = -0.3;
+    double nearFullLayers = 0.5;
+    // per layer removed on the way to the board, see evaluate
+    double removedLayers = 3.0;
+
+    // the weights above in order, e.g., for optimizers
+    static const int N_WEIGHTS = 8;
+    double &operator[](int i);
+    double operator[](int i) const;
+};
+
+double evaluate(const BoardFeatures &features, int nRemovedLayers, const FeatureWeights &weights);
+
+// Computes BoardFeatures from layer masks in the GameState layout, bit
+// y*dims.x + x of layers[z], i.e., GameState::layers or GameBatch::getLayers.
+// The per-layer terms use popcount, the per-column terms run as SIMD over
+// the columns with AVX2 or SSE4.1 when the CPU has them
+class BoardFeatureExtractor {
+public:
+    enum class Simd { SCALAR, SSE41, AVX2 };
+
+    // the best instruction set supported by this CPU
+    static Simd bestSimd();
+
+    // dims.x*dims.y <= 64
+    BoardFeatureExtractor(Pos3d dimensions, Simd simd = bestSimd());
+
+    Simd getSimd() const { return simd; }
+
+    BoardFeatures compute(const uint64_t *layers) const;
+    // boards stored one after another, layers[board*dims.z + z]
+    void computeBatch(const uint64_t *layers, int nBoards, BoardFeatures *out) const;
+
+    static const int MAX_COLUMNS = 64;
+
+private:
+    const Pos3d dims;
+    const Simd simd;
+    const uint64_t fullLayer;
+    // -1 where the neighbor in the given direction is inside the board,
+    // 0 where it is a wall, per column index y*dims.x + x. Loaded unaligned
+    // so that extractors can be allocated with plain new
+    int32_t hasLeft[MAX_COLUMNS], hasRight[MAX_COLUMNS],
+        hasDown[MAX_COLUMNS], hasUp[MAX_COLUMNS], isColumn[MAX_COLUMNS];
+};
+
+#endif
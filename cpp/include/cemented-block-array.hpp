@@ -2,19 +2,42 @@
 #define __CEMENTED_BLOCK_ARRAY_HPP__
 
 #include "game-box.hpp"
+#include "change-journal.hpp"
+#include "piece-shapes.hpp"
+#include <cstdint>
+
+// one bit per (x,y) cell of a horizontal layer, bit index y*dims.x + x
+typedef uint64_t LayerMask;
 
 class CementedBlockArray {
 private:
-    const GameBox& box;
-    std::vector<bool> nonEmpty;
+    const Pos3d dims;
+    const LayerMask fullLayer;
+    std::vector<LayerMask> layers;
     std::vector<int> blockPieceIds;
+    // bit index as in the layers
+    std::vector<piece_shapes::ShapeMask> shapeMasks;
+    // one plus the z of the topmost block in each (x,y) column, 0 if empty,
+    // indexed like the layer mask bits
+    std::vector<int> columnHeights;
+    // zobrist::cellKey of each cell, indexed like blockPieceIds
+    std::vector<uint64_t> cellKeys;
+    uint64_t zobristKey;
+    ChangeJournal journal;
 
-    void clearBlock(Pos3d pos);
-    int getBlock(Pos3d pos) const;
     int getBlockPieceId(Pos3d pos) const;
+    void updateColumnHeights();
+    // XOR of the cell keys of the blocks in the layer if it were at height keyZ
+    uint64_t layerKey(LayerMask layer, int keyZ) const;
 
+    bool contains(Pos3d pos) const;
     int posToIndex(Pos3d pos) const;
+    int posToBitIndex(Pos3d pos) const;
+    LayerMask posToBit(Pos3d pos) const;
+    bool blocksFit(const Piece& piece) const;
 public:
+    static const int JOURNAL_CAPACITY = 256;
+
     CementedBlockArray(const GameBox& gameBox);
 
     bool pieceFits(const Piece& piece) const;
@@ -22,7 +45,30 @@ public:
 
     bool isLayerFull(int z) const;
     void removeLayer(int z);
+    // removes all full layers in one pass, returns the number removed
+    int removeFullLayers();
     std::vector<Block> getNonEmptyBlocks() const;
+    void forEachNonEmptyBlock(const BlockCallback& callback) const;
+
+    Pos3d getDimensions() const { return dims; }
+    int getColumnHeight(int x, int y) const;
+    // the layer masks and the column heights, as in GameState::layers, for
+    // readers that want them without copying
+    const LayerMask *getLayers() const { return layers.data(); }
+    const int *getColumnHeights() const { return columnHeights.data(); }
+    // how many steps the given (fitting) piece can move down before
+    // it would collide with the cemented blocks or the floor
+    int dropDistance(const Piece& piece) const;
+
+    const ChangeJournal& getJournal() const { return journal; }
+
+    // Zobrist key of the blocks, see zobrist.hpp. Kept up to date by all
+    // modifications
+    uint64_t getZobristKey() const { return zobristKey; }
+
+    // save or restore the blocks, see GameState
+    void saveTo(GameState &state) const;
+    void restoreFrom(const GameState &state);
 
     // helpers
     void setBlock(const Block& block);
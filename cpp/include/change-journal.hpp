@@ -0,0 +1,33 @@
+#ifndef __CHANGE_JOURNAL_HPP__
+#define __CHANGE_JOURNAL_HPP__
+
+#include "api.hpp"
+#include <vector>
+
+// Bounded log of the latest changes to the cemented blocks. Each change
+// increments the version by one
+class ChangeJournal {
+private:
+    std::vector<CementedChange> entries; // ring buffer
+    unsigned int version;
+    // changes before this version are not available
+    unsigned int historyStart;
+
+    void record(ChangeType type, const Block &block);
+public:
+    ChangeJournal(int capacity);
+
+    unsigned int getVersion() const { return version; }
+
+    void blockSet(const Block &block);
+    void layerRemoved(int z);
+    // bump the version and forget the previous changes, e.g., when the
+    // blocks were replaced as a whole
+    void discardHistory();
+
+    // append the changes made after the given version to the output.
+    // Returns false if they are no longer all in the journal
+    bool getChangesSince(unsigned int sinceVersion, std::vector<CementedChange> &out) const;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __EXPECTIMAX_HPP__
+#define __EXPECTIMAX_HPP__
+
+#include "api.hpp"
+#include "board-features.hpp"
+#include "game-box.hpp"
+#include "placement-generator.hpp"
+#include "transposition-table.hpp"
+#include "work-stealing-pool.hpp"
+#include <memory>
+#include <vector>
+
+// Expectimax search for the placement of the active piece. Max nodes choose
+// a placement, chance nodes average over the next piece. PieceGenerator
+// draws the prototype uniformly and then a uniform orientation, and the
+// orientations of a prototype reach nearly the same placements by rotating,
+// so a chance node averages over the N_PROTOTYPES prototypes, each spawned
+// in its first orientation. Unlike Autoplayer, the known upcoming pieces
+// are not used.
+//
+// Below the root only the maxCandidates best children of a max node by the
+// static evaluation are searched further. Children with the same board are
+// searched once, and chance node values are memoized by the Zobrist key of
+// the board and the remaining depth for the duration of a search, in a
+// transposition table shared by the threads. The chance nodes of the
+// root candidates run as tasks in the pool, the rest of the tree is
+// searched serially within those tasks
+class ExpectimaxSearch {
+public:
+    struct Result {
+        // false if the game is over
+        bool found;
+        Placement placement;
+        // expected evaluation, see FeatureWeights
+        double value;
+        // expected points from removed layers over the searched pieces
+        double expectedScore;
+        long nNodes;
+        long nEvaluations;
+        long nMemoHits;
+        double seconds;
+    };
+
+    // depth is the number of chance nodes on each path
+    ExpectimaxSearch(Pos3d dimensions, WorkStealingPool &pool, int depth = 1, int maxCandidates = 8);
+
+    ExpectimaxSearch(const ExpectimaxSearch&) = delete;
+    ExpectimaxSearch &operator=(const ExpectimaxSearch&) = delete;
+
+    void setWeights(const FeatureWeights &w) { weights = w; }
+
+    Result search(const GameState &state);
+    // inputs for the placement of the last search, ending with DROP
+    void getInputs(const Placement &placement, std::vector<PlacementInput> &inputs);
+
+    // search and apply the inputs, returns false if the game is over
+    bool play(Game &game);
+
+    // lookups and stores of the chance node memo over all searches
+    TranspositionTableStatistics getMemoStatistics() const { return memo.getStatistics(); }
+
+private:
+    struct Value {
+        double value;
+        double score;
+    };
+
+    // one placement generator and scratch per tree level
+    struct Level {
+        PlacementGenerator generator;
+        std::unique_ptr<GameState> state;
+        std::vector<uint64_t> boards;
+        std::vector<int> nRemoved;
+        std::vector<BoardFeatures> features;
+        std::vector<Value> values;
+        std::vector<int> order;
+        std::vector<uint64_t> hashes;
+
+        explicit Level(Pos3d dims);
+    };
+
+    // per-thread scratch, indexed by the pool worker index
+    struct Context {
+        BoardFeatureExtractor extractor;
+        std::vector< std::unique_ptr<Level> > levels;
+        long nNodes, nEvaluations, nMemoHits;
+
+        Context(Pos3d dims, int nLevels);
+    };
+
+    const GameBox gameBox;
+    WorkStealingPool &pool;
+    const int depth;
+    const int maxCandidates;
+    FeatureWeights weights;
+
+    // the spawn pose of each prototype in its first orientation
+    std::vector<int> spawnShapes;
+    std::vector<Pos3d> spawnCenters;
+
+    // the pool workers and one for the thread that calls search if it is
+    // not a worker, see Autoplayer
+    std::vector< std::unique_ptr<Context> > contexts;
+    std::thread::id searchThread;
+    // the root, kept for getInputs
+    Context rootContext;
+    // chance node values by board and depth
+    TranspositionTable<Value> memo;
+    std::unique_ptr<GameState> state;
+    std::vector<PlacementInput> inputs;
+
+    Context &localContext();
+    uint64_t boardKey(const uint64_t *board) const;
+    // expands the children of the board for the piece into the level and
+    // sorts them by static value, returns their number
+    int expand(Context &context, int level, const uint64_t *board, int shape, Pos3d center);
+    // the best child of the board for the piece, searched pliesLeft chance
+    // levels deep
+    Value maxNode(Context &context, int level, const uint64_t *board, int shape, Pos3d center, int pliesLeft);
+    Value chanceNode(Context &context, int level, const uint64_t *board, int pliesLeft);
+};
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __GAME_BATCH_HPP__
+#define __GAME_BATCH_HPP__
+
+#include "api.hpp"
+#include "game-box.hpp"
+#include "piece-generator.hpp"
+#include "piece-shapes.hpp"
+#include <cstdint>
+#include <vector>
+
+// Many independent games of the same size stepped in lockstep, e.g., for
+// training agents. The state is stored as structure-of-arrays with the
+// games as the innermost index so that the per-game loops run over
+// contiguous memory. Each game behaves exactly like a ConcreteGame with the
+// same seed given the same inputs and ticks.
+//
+// Cementing and the full layer sweep after actions run across all games at
+// once. Gravity in tick runs one game at a time: the pieces fall different
+// distances, and in bin/benchmark (batch/*) a per-game fall bounded by the
+// due steps beat lockstep passes over all games for both short and long
+// frames
+class GameBatch {
+public:
+    typedef uint64_t LayerMask;
+
+    enum class Action : uint8_t {
+        NONE,
+        MOVE_X_POS, MOVE_X_NEG, MOVE_Y_POS, MOVE_Y_NEG,
+        // in the order of piece_shapes::rotationIndex
+        ROTATE_X_CW, ROTATE_X_CCW, ROTATE_Y_CW, ROTATE_Y_CCW, ROTATE_Z_CW, ROTATE_Z_CCW,
+        DROP
+    };
+
+    // one game for each seed. Aborts unless GameState::isSupported(dimensions)
+    GameBatch(const std::vector<unsigned int> &randomSeeds, Pos3d dimensions);
+
+    GameBatch(const GameBatch&) = delete;
+    GameBatch &operator=(const GameBatch&) = delete;
+
+    int size() const { return nGames; }
+    Pos3d getDimensions() const { return gameBox.dims; }
+
+    // one action per game, ignored by the games that are over
+    void applyActions(const std::vector<Action> &actions);
+    // same as tick(dtMilliseconds) for each game, one game at a time
+    void tick(int dtMilliseconds);
+    void step(const std::vector<Action> &actions, int dtMilliseconds);
+
+    bool isOver(int game) const { return !alive[game]; }
+    int getScore(int game) const { return score[game]; }
+    int getTimeMs(int game) const { return timeMs[game]; }
+    int countAlive() const;
+
+    // masks of the cemented blocks on layer z of all games, bit y*dims.x + x
+    const LayerMask *getLayers(int z) const { return &layers[z*nGames]; }
+
+    // see Game::snapshot and Game::restore. Restoring a new game's
+    // snapshot restarts that game
+    void snapshot(int game, GameState &state) const;
+    void restore(int game, const GameState &state);
+
+private:
+    const GameBox gameBox;
+    const int nGames;
+    const int layerSize;
+    const LayerMask fullLayer;
+    std::vector<piece_shapes::ShapeMask> shapeMasks;
+
+    // cemented blocks, layers[z*nGames + game]
+    std::vector<LayerMask> layers;
+    // pieceIds[(z*layerSize + y*dims.x + x)*nGames + game]
+    std::vector<int> pieceIds;
+
+    // active pieces
+    std::vector<int> activeShape;
+    std::vector<int> activeX, activeY, activeZ;
+    std::vector<int> activePieceId;
+    std::vector<PieceGenerator> pieceGenerators;
+
+    std::vector<int> score;
+    std::vector<uint8_t> alive;
+    std::vector<int> timeMs;
+    std::vector<int> timeToNextDownMs;
+    std::vector<int> nDroppedPieces;
+
+    // per-step scratch: games whose piece landed
+    std::vector<uint8_t> landed;
+    std::vector<uint32_t> fullLayers;
+
+    bool fits(int game, int shape, int x, int y, int z) const;
+    // how far the active piece can move down, at most maxDistance
+    int dropDistance(int game, int maxDistance) const;
+    void applyAction(int game, Action action);
+    void spawn(int game);
+    void applyGravity(int game, int nSteps);
+    // cement the landed pieces, clear full layers and spawn new pieces
+    void lockAndClear();
+    void cement(int game);
+    void clearAndSpawn(int game, uint32_t full);
+    void removeFullLayers(int game, uint32_t full);
+};
+
+#endif
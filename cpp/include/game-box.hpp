@@ -2,6 +2,7 @@
 #define __GAME_BOX_HPP__
 
 #include "piece.hpp"
+#include "piece-shapes.hpp"
 
 class GameBox {
 public:
@@ -11,6 +12,17 @@ public:
     bool contains(Pos3d pos) const;
     bool contains(const Piece& piece) const;
     Piece translateToBounds(const Piece &piece) const;
+    // same for a piece_shapes orientation, returns the new center
+    Pos3d translateToBounds(int shape, Pos3d center) const {
+        const auto &o = piece_shapes::TABLE.orientations[shape];
+        if (center.x + o.min.x < 0) center.x = -o.min.x;
+        if (center.x + o.max.x >= dims.x) center.x = dims.x - 1 - o.max.x;
+        if (center.y + o.min.y < 0) center.y = -o.min.y;
+        if (center.y + o.max.y >= dims.y) center.y = dims.y - 1 - o.max.y;
+        if (center.z + o.min.z < 0) center.z = -o.min.z;
+        if (center.z + o.max.z >= dims.z) center.z = dims.z - 1 - o.max.z;
+        return center;
+    }
     int size() const { return dims.x*dims.y*dims.z; }
 };
 
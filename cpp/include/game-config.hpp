@@ -0,0 +1,14 @@
+#ifndef __GAME_CONFIG_HPP__
+#define __GAME_CONFIG_HPP__
+
+#include "api.hpp"
+
+// rules shared by ConcreteGame and GameBatch
+namespace game_config {
+    static const Pos3d DIMENSIONS { 5, 4, 14 };
+    static const int DROP_SCORE_MULTIPLIER = 1;
+    static const int REMOVAL_SCORE_MULTIPLIER = 20;
+    static const int DROP_INTERVAL_MS = 1000;
+}
+
+#endif
@@ -11,18 +11,42 @@ class ConcreteGame : public Game {
 private:
     bool rotate(Rotation);
 public:
+    // default dimensions: game_config::DIMENSIONS
     ConcreteGame(unsigned int randomSeed);
+    ConcreteGame(unsigned int randomSeed, Pos3d dimensions);
 
     std::vector<Block> getActiveBlocks() const override;
     std::vector<Block> getCementedBlocks() const override;
     std::vector<Block> getAllBlocks() const override;
 
+    void forEachActiveBlock(const BlockCallback& callback) const override;
+    void forEachCementedBlock(const BlockCallback& callback) const override;
+    void forEachBlock(const BlockCallback& callback) const override;
+
     bool isOver() const override;
     int getScore() const override;
     Pos3d getDimensions() const override;
 
+    unsigned int getActiveVersion() const override;
+    unsigned int getCementedVersion() const override;
+    bool getCementedChangesSince(unsigned int version,
+        std::vector<CementedChange> &changes) const override;
+
+    void snapshot(GameState &state) const override;
+    void restore(const GameState &state) override;
+
+    // Zobrist key of the cemented blocks and the active piece pose, equal
+    // to zobrist::stateKey of a snapshot
+    uint64_t getZobristKey() const;
+    // the cemented blocks, e.g., for ValueNetwork::evaluate
+    const CementedBlockArray &getCementedBlockArray() const { return blockArray; }
+
     // timed events
     bool tick(int dtMilliseconds) override;
+    int getTimeMs() const override;
+    bool advanceTo(int timeMs) override;
+    int msUntilNextEvent() const override;
+    bool advanceToNextEvent() override;
 
     // controls
     bool moveXY(int dx, int dy) override;
@@ -33,6 +57,8 @@ public:
 
 private:
     bool moveDown();
+    // same as n calls to moveDown, but with the fall computed analytically
+    void applyGravity(int nSteps);
 
     // set active piece to given candidate and return true. If it does not fit,
     // do not change active piece and return false.
@@ -42,10 +68,12 @@ private:
     CementedBlockArray blockArray;
     PieceGenerator pieceGenerator;
     Piece activePiece;
+    unsigned int activeVersion;
 
     int score;
     bool alive;
 
+    int timeMs;
     int timeToNextDownMs;
     int nDroppedPieces;
 };
@@ -0,0 +1,103 @@
+#ifndef __HINT_SERVICE_HPP__
+#define __HINT_SERVICE_HPP__
+
+#include "api.hpp"
+#include "autoplayer.hpp"
+#include "placement-generator.hpp"
+#include "work-stealing-pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Suggests a placement for the active piece of a game without slowing the
+// game down. request() copies a snapshot of the game into a preallocated
+// buffer and returns: the analysis runs on a background thread, with the
+// tasks of the searches in the pool, and never touches the game itself.
+//
+// The analysis is anytime: searches of increasing strength run one after
+// another until the budget of the request is used, and each one that
+// reaches deeper than the previous replaces the current hint. A new request
+// replaces the previous one, and getHint cancels the analysis once the game
+// has changed since the request (its active or cemented version). All
+// buffers are allocated up front, so the memory use does not grow with the
+// number of requests.
+//
+// request, getHint and cancel are meant for the game thread, waitForHint
+// for any other thread. They only wait for the short handoffs between the
+// threads, never for a search
+class HintService {
+public:
+    struct Hint {
+        // false if the game is over
+        bool found;
+        // the analysis of the request has ended, no better hint will follow
+        bool final;
+        // the inputs that place the active piece, ending with DROP
+        std::vector<PlacementInput> inputs;
+        // placement depth of the search, see Autoplayer::getLastDepth
+        int depth;
+        // time from the request to this hint
+        double seconds;
+    };
+
+    HintService(Pos3d dimensions, WorkStealingPool &pool);
+    ~HintService();
+
+    HintService(const HintService&) = delete;
+    HintService &operator=(const HintService&) = delete;
+
+    // analyse the current state of the game for at most budgetMs
+    void request(const Game &game, int budgetMs);
+
+    // the best hint for the request so far. Returns false if there is none
+    // yet or if the game has changed, which also cancels the analysis
+    bool getHint(const Game &game, Hint &hint);
+
+    // waits until the analysis of the last request ends or the timeout,
+    // returns false if there was no hint by then
+    bool waitForHint(Hint &hint, int timeoutMs);
+
+    // stop the analysis and forget its hint
+    void cancel();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // the searches, from the fastest to the strongest
+    std::vector< std::unique_ptr<Autoplayer> > stages;
+
+    // the snapshot buffers: written by the game thread, handed to the
+    // worker, and analysed, swapped instead of copied
+    std::unique_ptr<GameState> incoming, pending, working;
+
+    // guards everything below except the game thread fields
+    std::mutex mutex;
+    std::condition_variable wakeWorker, hintChanged;
+    bool stopping;
+    bool hasPending;
+    int pendingBudgetMs;
+    Clock::time_point pendingTime;
+    // id of the latest request, 0 for none. Read by the worker without
+    // the mutex to notice a cancel between searches
+    std::atomic<unsigned long> requestId;
+    // the request the hint belongs to
+    unsigned long hintRequestId;
+    bool hasHint;
+    Hint hint;
+
+    // game thread only: the versions of the requested state
+    unsigned int requestedActiveVersion, requestedCementedVersion;
+
+    std::vector<PlacementInput> stageInputs;
+    std::thread worker;
+
+    void run();
+    // one request on the worker thread
+    void analyse(unsigned long id, const GameState &state, int budgetMs, Clock::time_point start);
+};
+
+#endif
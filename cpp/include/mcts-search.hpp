@@ -0,0 +1,139 @@
+#ifndef __MCTS_SEARCH_HPP__
+#define __MCTS_SEARCH_HPP__
+
+#include "api.hpp"
+#include "arena.hpp"
+#include "game.hpp"
+#include "game-box.hpp"
+#include "placement-generator.hpp"
+#include "work-stealing-pool.hpp"
+#include "xoshiro.hpp"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Monte Carlo tree search for the placement of the active piece. The tree
+// alternates between decision nodes, a board and a piece to place with one
+// child per reachable placement, and chance nodes, the board after a
+// placement with one child per next piece seen so far. The next pieces are
+// sampled with PieceGenerator::randomShape, i.e., from the same distribution
+// as the game.
+//
+// Each playout selects placements by UCB1 down to a leaf, expands it, and
+// plays rolloutPieces random pieces from there with a ConcreteGame. The
+// reward is the fraction of the rollout pieces placed before the game
+// ended plus layerBonus per layer removed on the whole path. Playouts run
+// as tasks in the work-stealing pool, all sharing the tree: the statistics
+// are atomics, and a selected path gets a virtual loss until its reward is
+// added so that concurrent playouts spread out. The nodes are allocated
+// from per-thread arenas that are reset for each search
+class MctsSearch {
+public:
+    struct Result {
+        // false if the game is over
+        bool found;
+        Placement placement;
+        // mean reward of the chosen placement and its playouts
+        double value;
+        int visits;
+        long nPlayouts;
+        double seconds;
+        double playoutsPerSecond;
+    };
+
+    MctsSearch(Pos3d dimensions, WorkStealingPool &pool, int rolloutPieces = 10, double layerBonus = 0.25);
+
+    MctsSearch(const MctsSearch&) = delete;
+    MctsSearch &operator=(const MctsSearch&) = delete;
+
+    // runs nPlayouts playouts or until the time budget is used if
+    // budgetMs > 0, and chooses the most visited placement
+    Result search(const GameState &state, long nPlayouts, int budgetMs = 0);
+    // inputs for the placement of the last search, ending with DROP
+    void getInputs(const Placement &placement, std::vector<PlacementInput> &inputs);
+
+    // search and apply the inputs, returns false if the game is over
+    bool play(Game &game, long nPlayouts, int budgetMs = 0);
+
+    // arena bytes used by the last search
+    std::size_t getTreeBytes() const;
+
+private:
+    struct ChanceNode;
+
+    struct Statistics {
+        // including virtual visits of playouts in progress
+        std::atomic<int> visits;
+        // sum of the rewards, in units of 1/REWARD_SCALE
+        std::atomic<long long> rewardSum;
+
+        Statistics() : visits(0), rewardSum(0) {}
+    };
+
+    struct DecisionNode {
+        enum { UNEXPANDED, EXPANDING, EXPANDED };
+
+        const uint64_t *board;
+        int shape;
+        Pos3d center;
+        Statistics stats;
+        std::atomic<int> state;
+        // placements of the piece, none if it does not fit
+        int nChildren;
+        ChanceNode *children;
+        // next sibling under the same chance node
+        DecisionNode *next;
+
+        DecisionNode() : board(nullptr), shape(0), center { 0, 0, 0 }, state(UNEXPANDED),
+            nChildren(0), children(nullptr), next(nullptr) {}
+    };
+
+    // the board is only built for the decision nodes below
+    struct ChanceNode {
+        Placement placement;
+        int nRemoved;
+        Statistics stats;
+        // children by the next piece, a list extended with compare-and-swap
+        std::atomic<DecisionNode*> outcomes;
+
+        ChanceNode() : placement { 0, { 0, 0, 0 } }, nRemoved(0), outcomes(nullptr) {}
+    };
+
+    // per-thread scratch, indexed by the pool worker index
+    struct Context {
+        Arena arena;
+        PlacementGenerator generator;
+        ConcreteGame game;
+        std::unique_ptr<GameState> state;
+        std::vector<uint64_t> board;
+        Xoshiro128 random;
+        std::vector<ChanceNode*> path;
+        std::vector<DecisionNode*> decisions;
+
+        Context(Pos3d dims, uint64_t seed);
+    };
+
+    const GameBox gameBox;
+    WorkStealingPool &pool;
+    const int rolloutPieces;
+    const double layerBonus;
+
+    // the pool workers and one for the thread that calls search if it is
+    // not a worker, see Autoplayer
+    std::vector< std::unique_ptr<Context> > contexts;
+    std::thread::id searchThread;
+    // the root, kept for getInputs
+    std::unique_ptr<Context> rootContext;
+    DecisionNode *root;
+    std::unique_ptr<GameState> state;
+    std::vector<PlacementInput> inputs;
+
+    Context &localContext();
+    void expand(Context &context, DecisionNode &node);
+    DecisionNode *outcome(Context &context, const DecisionNode &parent, ChanceNode &node);
+    ChanceNode *select(DecisionNode &node) const;
+    double rollout(Context &context, const DecisionNode &node);
+    void playout(Context &context);
+};
+
+#endif
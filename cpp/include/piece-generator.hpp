@@ -3,20 +3,24 @@
 
 #include "piece.hpp"
 #include "game-box.hpp"
-#include <vector>
-#include <random>
+#include "xoshiro.hpp"
 
 class PieceGenerator {
 private:
-    std::mt19937 random;
+    Xoshiro128 random;
     const GameBox& gameBox;
     int pieceId;
-    std::vector< std::vector<Pos3d> > prototypes;
-
-    Piece randomTransformation(const Piece& original);
 public:
+    // the piece sequence for a given seed is the same on all platforms
     PieceGenerator(const GameBox &gameBox, int randomSeed);
     Piece nextPiece();
+
+    // the piece_shapes orientation of the next piece drawn from the random
+    // generator: a uniform prototype and a uniform orientation of it
+    static int randomShape(Xoshiro128 &random);
+
+    void saveTo(GameState &state) const;
+    void restoreFrom(const GameState &state);
 };
 
 #endif
@@ -0,0 +1,81 @@
+#ifndef __PIECE_SHAPES_HPP__
+#define __PIECE_SHAPES_HPP__
+
+#include "piece.hpp"
+#include <cstdint>
+#include <vector>
+
+// All distinct orientations of the piece prototypes, computed at compile
+// time. An orientation is identified by its index in TABLE.orientations
+namespace piece_shapes {
+    const int N_PROTOTYPES = 8;
+    const int N_BLOCKS = 4;
+    const int N_ROTATIONS = 6;
+    const int MAX_ORIENTATIONS = 24;
+
+    struct Orientation {
+        // block positions relative to the piece center, sorted
+        Pos3d blocks[N_BLOCKS];
+        // bounding box of the blocks (inclusive)
+        Pos3d min, max;
+        // orientation after each rotation, see rotationIndex
+        int next[N_ROTATIONS];
+        int prototype;
+    };
+
+    struct ShapeTable {
+        Orientation orientations[N_PROTOTYPES*MAX_ORIENTATIONS];
+        // orientations of prototype i are first[i], ..., first[i]+count[i]-1
+        int first[N_PROTOTYPES];
+        int count[N_PROTOTYPES];
+        int size;
+    };
+
+    constexpr int rotationIndex(Rotation rot) {
+        return static_cast<int>(rot.axis)*2 +
+            (rot.direction == RotationDirection::CCW ? 1 : 0);
+    }
+
+    constexpr Rotation indexToRotation(int index) {
+        return Rotation {
+            static_cast<Axis>(index / 2),
+            index % 2 == 1 ? RotationDirection::CCW : RotationDirection::CW
+        };
+    }
+
+    extern const ShapeTable TABLE;
+
+    // occupancy of an orientation relative to its bounding box for boards
+    // stored as one bit mask per layer: bit dy*dims.x + dx of layers[dz]
+    // is set if there is a block at min + (dx, dy, dz)
+    struct ShapeMask {
+        Pos3d min, max;
+        uint64_t layers[N_BLOCKS];
+    };
+
+    // the masks of all orientations of TABLE for boards dims.x wide
+    std::vector<ShapeMask> buildShapeMasks(Pos3d dims);
+
+    // whether the orientation with the given center is inside a box of
+    // dims and does not overlap the blocks of the board, whose layer z is
+    // layers[z*layerStep]
+    inline bool shapeFits(const ShapeMask &mask, Pos3d center, Pos3d dims,
+        const uint64_t *layers, int layerStep = 1)
+    {
+        const Pos3d min = pos_methods::sum(center, mask.min);
+        if (min.x < 0 || min.y < 0 || min.z < 0 ||
+            center.x + mask.max.x >= dims.x ||
+            center.y + mask.max.y >= dims.y ||
+            center.z + mask.max.z >= dims.z) return false;
+
+        // the bounding box is inside the game box so shifted rows cannot wrap
+        const int shift = min.y*dims.x + min.x;
+        const int nLayers = mask.max.z - mask.min.z + 1;
+        for (int i = 0; i < nLayers; ++i) {
+            if (layers[(min.z + i)*layerStep] & (mask.layers[i] << shift)) return false;
+        }
+        return true;
+    }
+}
+
+#endif
@@ -2,27 +2,72 @@
 #define __PIECE_HPP__
 
 #include "api.hpp"
-#include <vector>
+#include <cstddef>
+#include <initializer_list>
+#include <assert.h>
 
 struct Rotation {
     Axis axis;
     RotationDirection direction;
 };
 
+// Fixed-capacity block container stored inline so that copying, moving
+// and rotating pieces never touches the heap
+class BlockList {
+public:
+    static const int MAX_SIZE = 4;
+
+    BlockList() : count(0) {}
+    BlockList(std::initializer_list<Block> list) : count(0) {
+        for (const Block &b : list) push_back(b);
+    }
+
+    void push_back(const Block &b) {
+        assert(count < MAX_SIZE);
+        items[count++] = b;
+    }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    Block& operator[](std::size_t i) { return items[i]; }
+    const Block& operator[](std::size_t i) const { return items[i]; }
+
+    Block* begin() { return items; }
+    Block* end() { return items + count; }
+    const Block* begin() const { return items; }
+    const Block* end() const { return items + count; }
+
+private:
+    Block items[MAX_SIZE];
+    int count;
+};
+
 struct Piece {
 private:
     Pos3d center;
-    std::vector<Block> blocks;
+    BlockList blocks;
+    // index to piece_shapes::TABLE or NO_SHAPE for arbitrary block lists
+    int shape;
 
 public:
-    Piece(std::vector<Block> blocks_)
+    static const int NO_SHAPE = -1;
+
+    Piece(BlockList blocks_)
     : Piece(Pos3d {0,0,0}, blocks_) {}
 
-    Piece(Pos3d center_, std::vector<Block> blocks_)
-    : center(center_), blocks(blocks_) {}
+    Piece(Pos3d center_, BlockList blocks_)
+    : center(center_), blocks(blocks_), shape(NO_SHAPE) {}
+
+    // piece whose blocks are given by a precomputed shape orientation
+    Piece(Pos3d center_, int shape_, int pieceId);
 
     Piece(const Piece& other) = default;
-    std::vector<Block> getBlocks() const;
+    Piece& operator=(const Piece& other) = default;
+    BlockList getBlocks() const;
+
+    int getShape() const { return shape; }
+    Pos3d getCenter() const { return center; }
 
     Piece translated(Pos3d) const;
     Piece rotated(Rotation) const;
@@ -38,10 +83,26 @@ namespace block_methods {
 }
 
 namespace pos_methods {
-    inline Pos3d sum(Pos3d a, Pos3d b) {
+    constexpr Pos3d sum(Pos3d a, Pos3d b) {
         return Pos3d { a.x + b.x, a.y + b.y, a.z + b.z };
     }
 
+    constexpr Pos3d rotate(Pos3d pos, Rotation rot) {
+        // 90 degeree rotation along X, Y or Z means exchanging/swapping
+        // the values of the other two axes and flipping the sign on
+        // one of these. The sign determines on which axis it is flipped
+        const int sign = rot.direction == RotationDirection::CCW ? 1 : -1;
+        switch (rot.axis) {
+        case Axis::X:
+            return Pos3d { pos.x, -sign*pos.z, sign*pos.y };
+        case Axis::Y:
+            return Pos3d { sign*pos.z, pos.y, -sign*pos.x };
+        case Axis::Z:
+        default:
+            return Pos3d { -sign*pos.y, sign*pos.x, pos.z };
+        }
+    }
+
     int getElement(const Pos3d &pos, Axis ax);
 }
 
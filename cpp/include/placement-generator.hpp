@@ -0,0 +1,118 @@
+#ifndef __PLACEMENT_GENERATOR_HPP__
+#define __PLACEMENT_GENERATOR_HPP__
+
+#include "api.hpp"
+#include "game-box.hpp"
+#include "piece-shapes.hpp"
+#include <cstdint>
+#include <vector>
+
+// inputs of a placement, applied with placements::applyInput
+enum class PlacementInput : uint8_t {
+    MOVE_X_POS, MOVE_X_NEG, MOVE_Y_POS, MOVE_Y_NEG,
+    // in the order of piece_shapes::rotationIndex
+    ROTATE_X_CW, ROTATE_X_CCW, ROTATE_Y_CW, ROTATE_Y_CCW, ROTATE_Z_CW, ROTATE_Z_CCW,
+    // let gravity move the piece down one step (Game::advanceToNextEvent)
+    WAIT,
+    DROP
+};
+
+// final resting pose of the active piece
+struct Placement {
+    int shape;
+    Pos3d center;
+};
+
+// Enumerates all distinct placements the active piece can reach with the
+// game controls. Uses the same fit, rotation and bounds rules as
+// ConcreteGame so the inputs reach the placement when applied to the game
+// before the next timed event. Placements with the same cells are only
+// listed once.
+//
+// The reachable poses are found by a flood fill over the orientation and
+// height planes, with all x, y positions of a plane as one bit mask. The
+// input sequences need the individual poses and are found by a separate
+// breadth-first search over the poses, only as far as asked for
+class PlacementGenerator {
+public:
+    PlacementGenerator(Pos3d dimensions);
+
+    // the placements for the active piece of the state (none if the game is
+    // over), valid until the next call
+    const std::vector<Placement> &generate(const GameState &state);
+    // the result of the last generate
+    const std::vector<Placement> &getPlacements() const { return placements; }
+
+    // shortest input sequence to a placement of the last generate, ending
+    // with DROP
+    void getInputs(const Placement &placement, std::vector<PlacementInput> &inputs);
+
+    // number of poses reachable in the last generate
+    int getNodeCount() const { return nReachable; }
+
+    // whether the piece pose fits the given layers, in the GameState layout
+    bool fits(const uint64_t *layers, int shape, Pos3d center) const;
+
+    // cements the placement into the layers and removes the full layers
+    // like the game would, returns the number of layers removed
+    int place(const Placement &placement, uint64_t *layers) const;
+
+private:
+    struct Node {
+        int shape;
+        Pos3d center;
+        int parent;
+        PlacementInput input;
+    };
+
+    const GameBox gameBox;
+    // bit y*dims.x + x as in GameState::layers
+    std::vector<piece_shapes::ShapeMask> shapeMasks;
+    // centers (bit y*dims.x + x) of each orientation where x and y are
+    // within the bounds
+    std::vector<uint64_t> inBounds;
+    // first orientation with the same blocks relative to the bounding box
+    std::vector<int> canonicalShape;
+    // centers not in the last or the first column
+    uint64_t notLastColumn, notFirstColumn;
+    uint64_t layers[GameState::MAX_HEIGHT];
+
+    // the last generate: the orientations of the active prototype and the
+    // fitting and reachable centers per plane, plane = (shape - firstShape)*dims.z + z
+    int startShape;
+    Pos3d startCenter;
+    int firstShape, nShapes;
+    uint64_t fitting[piece_shapes::MAX_ORIENTATIONS*GameState::MAX_HEIGHT];
+    uint64_t reachable[piece_shapes::MAX_ORIENTATIONS*GameState::MAX_HEIGHT];
+    std::vector<int> pending;
+    std::vector<bool> isPending;
+    int nReachable;
+    std::vector<Placement> placements;
+    std::vector<uint64_t> landed;
+
+    // the breadth-first search for getInputs, continued from where it was
+    // left until it reaches the asked placement
+    bool searched;
+    std::vector<Node> nodes;
+    std::size_t nExpanded;
+    std::vector<uint64_t> visited;
+    // first node that lands on each placement, by poseIndex
+    std::vector<int> landedNode;
+    // z where each pose comes to rest when dropped, -1 if not computed yet
+    std::vector<int8_t> restingZ;
+
+    int poseIndex(int shape, Pos3d boundingBoxMin) const;
+    int landedIndex(int shape, Pos3d center) const;
+    bool fits(int shape, Pos3d center) const { return fits(layers, shape, center); }
+    uint64_t fittingCenters(int shape, int z) const;
+    void reach(int shape, int z, uint64_t centers);
+    int getRestingZ(int shape, Pos3d center);
+    void visit(int shape, Pos3d center, int parent, PlacementInput input);
+    void searchUntil(int landedIndex);
+};
+
+namespace placements {
+    void applyInput(Game &game, PlacementInput input);
+}
+
+#endif
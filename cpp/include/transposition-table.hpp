@@ -0,0 +1,232 @@
+#ifndef __TRANSPOSITION_TABLE_HPP__
+#define __TRANSPOSITION_TABLE_HPP__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// see TranspositionTable
+struct TranspositionTableStatistics {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t collisions;
+    uint64_t stores;
+};
+
+// Fixed-size hash table from 64-bit position keys, e.g., Zobrist keys, to
+// search results, shared by any number of threads without locks. Each key
+// maps to a bucket of BUCKET_SIZE entries. An entry is stored as atomic
+// words guarded by a sequence number that is odd while a write is in
+// progress: a read that races with a write sees the number change and is
+// treated as a miss instead of returning a mix of two values, and a write
+// that finds the entry being written by another thread is dropped. Nothing
+// ever waits, which suits tables whose contents can always be recomputed.
+//
+// When a bucket is full, a store replaces the entry of the same key, or an
+// entry from an older generation, or the one with the lowest priority, e.g.,
+// the shallowest search depth. newGeneration() makes all entries stale in
+// constant time, e.g., between searches whose values are not comparable.
+//
+// The statistics count the lookups that found their key (hits) or not
+// (misses), the stores, and the stores that evicted a current entry with
+// another key (collisions), summed over all threads
+template <class Value>
+class TranspositionTable {
+public:
+    static const int BUCKET_SIZE = 2;
+
+    typedef TranspositionTableStatistics Statistics;
+
+    // the number of entries is rounded up to a power of two
+    explicit TranspositionTable(std::size_t nEntries);
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable &operator=(const TranspositionTable&) = delete;
+
+    bool find(uint64_t key, Value &value);
+    void store(uint64_t key, const Value &value, unsigned int priority = 0);
+
+    void newGeneration();
+    // empty all entries, not safe concurrently with other calls
+    void clear();
+
+    std::size_t getEntryCount() const { return nBuckets*BUCKET_SIZE; }
+    std::size_t getBytes() const { return nBuckets*sizeof(Bucket); }
+
+    Statistics getStatistics() const;
+    void resetStatistics();
+
+private:
+    static_assert(std::is_trivially_copyable<Value>::value, "values are copied as words");
+    static const int N_WORDS = (sizeof(Value) + 7) / 8;
+
+    // meta: OCCUPIED | generation << GENERATION_SHIFT | priority
+    static const uint64_t OCCUPIED = uint64_t(1) << 63;
+    static const int GENERATION_SHIFT = 32;
+    static const uint64_t GENERATION_MASK = 0x7fffffff;
+    static const uint64_t PRIORITY_MASK = 0xffffffff;
+
+    struct Entry {
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> meta;
+        std::atomic<uint64_t> words[N_WORDS];
+    };
+
+    struct Bucket {
+        Entry entries[BUCKET_SIZE];
+    };
+
+    // spread over cache lines so that the counting threads do not all
+    // write the same one
+    struct Counters {
+        std::atomic<uint64_t> hits, misses, collisions, stores;
+        char padding[64 - 4*sizeof(std::atomic<uint64_t>)];
+    };
+    static const int N_COUNTERS = 16;
+
+    std::size_t nBuckets;
+    std::unique_ptr<Bucket[]> buckets;
+    std::atomic<uint64_t> generation;
+    Counters counters[N_COUNTERS];
+
+    Bucket &bucketOf(uint64_t key) { return buckets[key & (nBuckets - 1)]; }
+    Counters &countersOf(uint64_t key) { return counters[(key >> 58) % N_COUNTERS]; }
+    uint64_t currentGeneration() const { return generation.load(std::memory_order_relaxed); }
+
+    bool isCurrent(uint64_t meta, uint64_t gen) const {
+        return (meta & OCCUPIED) && ((meta >> GENERATION_SHIFT) & GENERATION_MASK) == gen;
+    }
+};
+
+template <class Value>
+const int TranspositionTable<Value>::BUCKET_SIZE;
+
+template <class Value>
+TranspositionTable<Value>::TranspositionTable(std::size_t nEntries)
+:
+    nBuckets(1),
+    generation(0)
+{
+    while (nBuckets*BUCKET_SIZE < nEntries) nBuckets *= 2;
+    buckets.reset(new Bucket[nBuckets]);
+    clear();
+    resetStatistics();
+}
+
+template <class Value>
+bool TranspositionTable<Value>::find(uint64_t key, Value &value) {
+    Bucket &bucket = bucketOf(key);
+    const uint64_t gen = currentGeneration();
+    for (Entry &entry : bucket.entries) {
+        const uint64_t before = entry.sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        const uint64_t entryKey = entry.key.load(std::memory_order_relaxed);
+        const uint64_t meta = entry.meta.load(std::memory_order_relaxed);
+        uint64_t words[N_WORDS];
+        for (int i = 0; i < N_WORDS; ++i) words[i] = entry.words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.sequence.load(std::memory_order_relaxed) != before) continue;
+
+        if (entryKey != key || !isCurrent(meta, gen)) continue;
+        std::memcpy(&value, words, sizeof(Value));
+        countersOf(key).hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    countersOf(key).misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+template <class Value>
+void TranspositionTable<Value>::store(uint64_t key, const Value &value, unsigned int priority) {
+    Bucket &bucket = bucketOf(key);
+    const uint64_t gen = currentGeneration();
+
+    // the same key, else the entry least worth keeping: empty or stale
+    // first, then by priority. Racy reads only make the choice worse
+    Entry *target = nullptr;
+    uint64_t targetRank = ~uint64_t(0);
+    bool evicts = false;
+    for (Entry &entry : bucket.entries) {
+        const uint64_t meta = entry.meta.load(std::memory_order_relaxed);
+        const bool current = isCurrent(meta, gen);
+        if (current && entry.key.load(std::memory_order_relaxed) == key) {
+            target = &entry;
+            evicts = false;
+            break;
+        }
+        const uint64_t rank = current ? (PRIORITY_MASK + 1) + (meta & PRIORITY_MASK) : 0;
+        if (rank < targetRank) {
+            target = &entry;
+            targetRank = rank;
+            evicts = current;
+        }
+    }
+
+    uint64_t sequence = target->sequence.load(std::memory_order_relaxed);
+    if ((sequence & 1) || !target->sequence.compare_exchange_strong(sequence, sequence + 1,
+        std::memory_order_acquire, std::memory_order_relaxed))
+    {
+        // another thread is writing the entry
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t words[N_WORDS] = {};
+    std::memcpy(words, &value, sizeof(Value));
+    target->key.store(key, std::memory_order_relaxed);
+    target->meta.store(OCCUPIED | (gen << GENERATION_SHIFT) | (priority & PRIORITY_MASK),
+        std::memory_order_relaxed);
+    for (int i = 0; i < N_WORDS; ++i) target->words[i].store(words[i], std::memory_order_relaxed);
+    target->sequence.store(sequence + 2, std::memory_order_release);
+
+    Counters &c = countersOf(key);
+    c.stores.fetch_add(1, std::memory_order_relaxed);
+    if (evicts) c.collisions.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <class Value>
+void TranspositionTable<Value>::newGeneration() {
+    const uint64_t next = (generation.load(std::memory_order_relaxed) + 1) & GENERATION_MASK;
+    // after a wrap-around, old entries could look current again
+    if (next == 0) clear();
+    generation.store(next, std::memory_order_relaxed);
+}
+
+template <class Value>
+void TranspositionTable<Value>::clear() {
+    for (std::size_t b = 0; b < nBuckets; ++b) {
+        for (Entry &entry : buckets[b].entries) {
+            entry.sequence.store(0, std::memory_order_relaxed);
+            entry.key.store(0, std::memory_order_relaxed);
+            entry.meta.store(0, std::memory_order_relaxed);
+            for (auto &word : entry.words) word.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+template <class Value>
+typename TranspositionTable<Value>::Statistics TranspositionTable<Value>::getStatistics() const {
+    Statistics s { 0, 0, 0, 0 };
+    for (const Counters &c : counters) {
+        s.hits += c.hits.load(std::memory_order_relaxed);
+        s.misses += c.misses.load(std::memory_order_relaxed);
+        s.collisions += c.collisions.load(std::memory_order_relaxed);
+        s.stores += c.stores.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+template <class Value>
+void TranspositionTable<Value>::resetStatistics() {
+    for (Counters &c : counters) {
+        c.hits.store(0, std::memory_order_relaxed);
+        c.misses.store(0, std::memory_order_relaxed);
+        c.collisions.store(0, std::memory_order_relaxed);
+        c.stores.store(0, std::memory_order_relaxed);
+    }
+}
+
+#endif
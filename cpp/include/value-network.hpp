@@ -0,0 +1,112 @@
+#ifndef __VALUE_NETWORK_HPP__
+#define __VALUE_NETWORK_HPP__
+
+#include "api.hpp"
+#include "cemented-block-array.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small learned board evaluator: an MLP with two hidden ReLU layers and a
+// scalar output, evaluated on the CPU. The inputs are the occupancy of each
+// cell, cell z*dims.x*dims.y + y*dims.x + x, followed by the column heights,
+// column y*dims.x + x, as unsigned bytes and zero padded to a multiple of
+// INPUT_ALIGNMENT. The first layer, the largest one, is quantized: int8
+// weights and an fp32 scale per neuron, so that its dot products run on
+// integers,
+//
+//   h1 = relu(scale1 * (w1 . input) + bias1)
+//   h2 = relu(w2 h1 + bias2)
+//   value = w3 . h2 + bias3
+//
+// with the other layers in fp32. The dot products use AVX2 when the CPU has
+// it and plain loops otherwise.
+//
+// The weights are loaded from a flat little-endian binary file that is
+// memory-mapped, not copied:
+//
+//   FileHeader
+//   int8  w1[nHidden1][paddedInputs]  (row-major, the padding weights are 0)
+//   float scale1[nHidden1], bias1[nHidden1]
+//   float w2[nHidden2][nHidden1], bias2[nHidden2]
+//   float w3[nHidden2], bias3
+//
+// Not available in the browser build
+class ValueNetwork {
+public:
+    enum class Simd { SCALAR, AVX2 };
+
+    static const int INPUT_ALIGNMENT = 32;
+    static const int MAX_HIDDEN = 256;
+
+    struct FileHeader {
+        // "3DTRISNN"
+        char magic[8];
+        uint32_t version;
+        int32_t dimX, dimY, dimZ;
+        int32_t nHidden1, nHidden2;
+        uint32_t reserved[8];
+    };
+
+    // weights in memory, e.g., for writing a file. w1 is nHidden1 x
+    // nInputs, without padding
+    struct Weights {
+        Pos3d dimensions;
+        int nHidden1, nHidden2;
+        std::vector<int8_t> w1;
+        std::vector<float> scale1, bias1, w2, bias2, w3;
+        float bias3;
+    };
+
+    // the best instruction set supported by this CPU
+    static Simd bestSimd();
+
+    explicit ValueNetwork(Simd simd = bestSimd());
+    ~ValueNetwork();
+
+    ValueNetwork(const ValueNetwork&) = delete;
+    ValueNetwork &operator=(const ValueNetwork&) = delete;
+
+    // maps the weight file, returns false if it cannot be read or does not
+    // have the format above. Replaces any previously loaded weights
+    bool load(const char *path);
+    bool isLoaded() const { return mapping != nullptr; }
+
+    static bool write(const char *path, const Weights &weights);
+
+    Pos3d getDimensions() const { return dims; }
+    int getInputCount() const { return nInputs; }
+    Simd getSimd() const { return simd; }
+
+    // layer masks in the GameState layout, boards stored one after another,
+    // layers[board*dims.z + z]. Thread safe. A convenience API: the boards
+    // are evaluated one by one, as the first layer is bound by the
+    // multiply-adds rather than reading the weights, which stay in the
+    // cache. Four boards per pass over the weight rows measured the same in
+    // bin/benchmark network/*, also with a 256 x 960 first layer
+    void evaluateBatch(const uint64_t *layers, int nBoards, float *values) const;
+    float evaluate(const uint64_t *layers) const;
+    // the blocks of a game, read in place, see
+    // ConcreteGame::getCementedBlockArray. Aborts if the dimensions are not
+    // those of the network
+    float evaluate(const CementedBlockArray &blocks) const;
+
+private:
+    const Simd simd;
+
+    void *mapping;
+    std::size_t mappingSize;
+
+    Pos3d dims;
+    int nInputs, paddedInputs;
+    int nHidden1, nHidden2;
+    const int8_t *w1;
+    const float *scale1, *bias1, *w2, *bias2, *w3;
+    float bias3;
+
+    void unload();
+    // the network on prepared inputs
+    float forward(const uint8_t *input) const;
+};
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef __WORK_STEALING_POOL_HPP__
+#define __WORK_STEALING_POOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGroup;
+
+// Thread pool where each worker has its own task deque. Workers run their
+// own newest tasks first and steal the oldest tasks of the other workers
+// when they run out. Only for the native tools, not used by the game itself
+class WorkStealingPool {
+public:
+    typedef std::function<void()> Task;
+
+    // nThreads <= 0 means one thread per hardware thread
+    explicit WorkStealingPool(int nThreads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool&) = delete;
+
+    int getThreadCount() const { return static_cast<int>(threads.size()); }
+
+    // tasks submitted from a worker thread go to its own deque, others
+    // are distributed round-robin
+    void submit(Task task);
+
+    // run one queued task in the calling thread, if there is any
+    bool runPendingTask();
+
+    // index of the calling worker thread in this pool, -1 for other threads
+    int getWorkerIndex() const;
+
+private:
+    friend class TaskGroup;
+
+    struct Entry {
+        Task task;
+        // the group the task belongs to, or null
+        const TaskGroup *group;
+    };
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Entry> tasks;
+    };
+
+    std::vector< std::unique_ptr<TaskQueue> > queues;
+    std::vector<std::thread> threads;
+    std::atomic<unsigned int> nextQueue;
+
+    // queued (not yet started) tasks. The mutex is only taken by workers
+    // going to sleep and by submits that wake them
+    std::atomic<int> nQueued;
+    std::atomic<int> nSleeping;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool stopping;
+
+    void push(Task task, const TaskGroup *group);
+    // any task if group is null, otherwise only the tasks of the group
+    bool runTask(const TaskGroup *group);
+    void workerLoop(int index);
+    bool popOwn(int index, const TaskGroup *group, Task &task);
+    bool steal(int thief, const TaskGroup *group, Task &task);
+};
+
+// Set of tasks whose completion can be waited for. The waiting thread runs
+// the queued tasks of the group meanwhile, and sleeps when the rest are
+// running elsewhere, so groups can be nested inside pool tasks. It never
+// runs tasks of other groups, which would stack unrelated work of any size
+// on top of the wait
+class TaskGroup {
+public:
+    explicit TaskGroup(WorkStealingPool &pool);
+    ~TaskGroup();
+
+    void run(WorkStealingPool::Task task);
+    void wait();
+
+private:
+    WorkStealingPool &pool;
+    // submitted and not finished, and of those, not yet started
+    std::atomic<int> nPending, nQueued;
+
+    // for waking a sleeping wait(): the last task has finished or a new
+    // task has been queued
+    std::atomic<int> nWaiting;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    void finished();
+};
+
+#endif
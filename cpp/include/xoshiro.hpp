@@ -0,0 +1,32 @@
+#ifndef __XOSHIRO_HPP__
+#define __XOSHIRO_HPP__
+
+#include <cstdint>
+
+// xoshiro128** pseudo-random number generator by Blackman & Vigna
+// (http://prng.di.unimi.it/). Unlike std::mt19937 with the standard
+// distributions, gives the same sequences on every platform and has
+// a small state
+class Xoshiro128 {
+public:
+    static const int STATE_SIZE = 4;
+
+    // the seed is expanded to the full state with SplitMix64
+    explicit Xoshiro128(uint64_t seed);
+
+    uint32_t next();
+    // uniform integer in [0, range), range > 0
+    uint32_t nextBelow(uint32_t range);
+
+    // advance the state by 2^64 steps, e.g., to create 2^64 non-overlapping
+    // subsequences for parallel computations
+    void jump();
+
+    void getState(uint32_t state[STATE_SIZE]) const;
+    void setState(const uint32_t state[STATE_SIZE]);
+
+private:
+    uint32_t s[STATE_SIZE];
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef __ZOBRIST_HPP__
+#define __ZOBRIST_HPP__
+
+#include "api.hpp"
+#include <cstdint>
+
+// Zobrist keys of game positions: the key of a board is the XOR of the keys
+// of its blocks, so it can be updated incrementally as blocks are added or
+// moved, see CementedBlockArray::getZobristKey. The key of a position
+// also includes the pose of the active piece. Cells are numbered
+// z*dims.x*dims.y + y*dims.x + x, the same for every Dims policy, so equal
+// positions get equal keys in all game variants
+namespace zobrist {
+    uint64_t cellKey(int cell);
+    uint64_t pieceKey(int shape, Pos3d center);
+
+    // full computation from GameState style layers, for checking or for
+    // positions that do not come from a game
+    uint64_t boardKey(const uint64_t *layers, Pos3d dims);
+    uint64_t stateKey(const GameState &state);
+}
+
+#endif
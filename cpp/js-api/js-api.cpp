@@ -1,8 +1,15 @@
 #include <emscripten/bind.h>
 #include "api.hpp"
 
+namespace js_api {
+    void forEachBlock(const Game& game, emscripten::val callback) {
+        game.forEachBlock([&callback](const Block &b) { callback(b); });
+    }
+}
+
 EMSCRIPTEN_BINDINGS(game_builder) {
-    emscripten::function("buildGame", &buildGame);
+    emscripten::function("buildGame",
+        emscripten::select_overload<std::unique_ptr<Game>(unsigned int)>(&buildGame));
 }
 
 EMSCRIPTEN_BINDINGS(game_types) {
@@ -32,11 +39,18 @@ EMSCRIPTEN_BINDINGS(game_api) {
     .function("isOver", &Game::isOver)
     .function("getScore", &Game::getScore)
     .function("getDimensions", &Game::getDimensions)
+    .function("getActiveVersion", &Game::getActiveVersion)
+    .function("getCementedVersion", &Game::getCementedVersion)
     .function("tick", &Game::tick)
+    .function("getTimeMs", &Game::getTimeMs)
+    .function("advanceTo", &Game::advanceTo)
+    .function("msUntilNextEvent", &Game::msUntilNextEvent)
+    .function("advanceToNextEvent", &Game::advanceToNextEvent)
     .function("moveXY", &Game::moveXY)
     .function("rotate", &Game::rotate)
     .function("drop", &Game::drop)
     .function("getCementedBlocks", &Game::getCementedBlocks)
     .function("getActiveBlocks", &Game::getActiveBlocks)
-    .function("getAllBlocks", &Game::getAllBlocks);
+    .function("getAllBlocks", &Game::getAllBlocks)
+    .function("forEachBlock", &js_api::forEachBlock);
 }
@@ -0,0 +1,43 @@
+#include "arena.hpp"
+#include <algorithm>
+#include <assert.h>
+
+Arena::Arena(std::size_t chunkSize)
+:
+    chunkSize(chunkSize),
+    current(0),
+    offset(0),
+    used(0)
+{}
+
+void *Arena::allocate(std::size_t size, std::size_t alignment) {
+    // offsets are aligned relative to the chunk start, which new[] aligns
+    // for any fundamental type
+    assert( alignment > 0 && (alignment & (alignment - 1)) == 0 );
+    assert( alignment <= alignof(std::max_align_t) );
+    for (;;) {
+        if (current < chunks.size()) {
+            const std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+            if (start + size <= chunkSizes[current]) {
+                offset = start + size;
+                used += size;
+                return chunks[current].get() + start;
+            }
+            // continue in the next chunk, the rest of this one is wasted
+            current++;
+            offset = 0;
+            continue;
+        }
+        // big enough for the allocation even if it is larger than the
+        // usual chunk size
+        const std::size_t newSize = std::max(chunkSize, size);
+        chunks.emplace_back(new char[newSize]);
+        chunkSizes.push_back(newSize);
+    }
+}
+
+void Arena::reset() {
+    current = 0;
+    offset = 0;
+    used = 0;
+}
@@ -0,0 +1,190 @@
+#include "autoplayer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <assert.h>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // below any board evaluation, boards where the game ends are only
+    // chosen if nothing else is possible
+    const double GAME_OVER_VALUE = -1e30;
+}
+
+Autoplayer::Context::Context(Pos3d dims)
+:
+    generator(dims),
+    extractor(dims),
+    state(new GameState())
+{}
+
+Autoplayer::Autoplayer(Pos3d dims, WorkStealingPool &pool, int beamWidth, int lookahead)
+:
+    gameBox(dims),
+    pool(pool),
+    beamWidth(beamWidth),
+    lookahead(lookahead),
+    rootContext(dims),
+    pieceGenerator(gameBox, 0),
+    state(new GameState()),
+    lastDepth(0),
+    lastEvaluated(0)
+{
+    assert( beamWidth > 0 && lookahead >= 0 );
+    for (int i = 0; i <= pool.getThreadCount(); ++i) {
+        contexts.emplace_back(new Context(dims));
+    }
+}
+
+Autoplayer::Context &Autoplayer::localContext() {
+    const int worker = pool.getWorkerIndex();
+    assert( worker >= 0 || std::this_thread::get_id() == searchThread );
+    return *contexts[worker < 0 ? pool.getThreadCount() : worker];
+}
+
+void Autoplayer::expand(Context &context, const uint64_t *board, const Node &parent,
+    const Piece &piece, const Piece &next,
+    std::vector<Node> &children, std::vector<uint64_t> &childBoards)
+{
+    const Pos3d dims = gameBox.dims;
+    GameState &s = *context.state;
+    s.dimensions = dims;
+    std::copy(board, board + dims.z, s.layers);
+    s.activeShape = piece.getShape();
+    s.activeCenter = piece.getCenter();
+    s.alive = true;
+
+    const std::vector<Placement> &placements = context.generator.generate(s);
+    const int n = static_cast<int>(placements.size());
+    const std::size_t first = childBoards.size();
+    childBoards.resize(first + n*dims.z);
+    context.nRemoved.resize(n);
+    for (int i = 0; i < n; ++i) {
+        uint64_t *child = &childBoards[first + i*dims.z];
+        std::copy(board, board + dims.z, child);
+        context.nRemoved[i] = context.generator.place(placements[i], child);
+    }
+
+    context.features.resize(n);
+    context.extractor.computeBatch(&childBoards[first], n, context.features.data());
+
+    for (int i = 0; i < n; ++i) {
+        Node child;
+        child.rootPlacement = parent.rootPlacement < 0 ? i : parent.rootPlacement;
+        child.nRemovedLayers = parent.nRemovedLayers + context.nRemoved[i];
+        child.over = !context.generator.fits(&childBoards[first + i*dims.z],
+            next.getShape(), next.getCenter());
+        child.value = child.over ? GAME_OVER_VALUE :
+            evaluate(context.features[i], child.nRemovedLayers, weights);
+        children.push_back(child);
+    }
+}
+
+void Autoplayer::selectBeam(std::vector<Node> &nodes, std::vector<uint64_t> &boards) const {
+    const int dimZ = gameBox.dims.z;
+    const int n = static_cast<int>(nodes.size());
+    const int nKept = std::min(n, beamWidth);
+
+    // by value, ties by the order of the nodes so the result does not
+    // depend on the threads
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::partial_sort(order.begin(), order.begin() + nKept, order.end(), [&](int a, int b) {
+        return nodes[a].value > nodes[b].value || (nodes[a].value == nodes[b].value && a < b);
+    });
+
+    std::vector<Node> keptNodes(nKept);
+    std::vector<uint64_t> keptBoards(nKept*dimZ);
+    for (int i = 0; i < nKept; ++i) {
+        keptNodes[i] = nodes[order[i]];
+        std::copy(&boards[order[i]*dimZ], &boards[order[i]*dimZ] + dimZ, &keptBoards[i*dimZ]);
+    }
+    nodes.swap(keptNodes);
+    boards.swap(keptBoards);
+}
+
+bool Autoplayer::chooseInputs(const GameState &current, int budgetMs, std::vector<PlacementInput> &result) {
+    const auto deadline = Clock::now() + std::chrono::milliseconds(budgetMs);
+    const bool hasDeadline = budgetMs > 0;
+    const int dimZ = gameBox.dims.z;
+    lastDepth = 0;
+    lastEvaluated = 0;
+    searchThread = std::this_thread::get_id();
+    if (!current.alive) return false;
+
+    // the active piece and the upcoming ones, plus the one after the last
+    // placed piece that has to fit
+    std::vector<Piece> pieces { Piece(current.activeCenter, current.activeShape, current.activePieceId) };
+    pieceGenerator.restoreFrom(current);
+    for (int i = 0; i <= lookahead; ++i) pieces.push_back(pieceGenerator.nextPiece());
+
+    Node root { -1, 0, false, 0.0 };
+    std::vector<Node> beam;
+    std::vector<uint64_t> beamBoards;
+    expand(rootContext, current.layers, root, pieces[0], pieces[1], beam, beamBoards);
+    if (beam.empty()) return false;
+    lastEvaluated = static_cast<long>(beam.size());
+    selectBeam(beam, beamBoards);
+    int best = beam[0].rootPlacement;
+    lastDepth = 1;
+
+    for (int depth = 1; depth <= lookahead; ++depth) {
+        if (hasDeadline && Clock::now() >= deadline) break;
+
+        const int nBeam = static_cast<int>(beam.size());
+        std::vector< std::vector<Node> > children(nBeam);
+        std::vector< std::vector<uint64_t> > childBoards(nBeam);
+        std::atomic<bool> cutOff(false);
+        {
+            TaskGroup tasks(pool);
+            for (int b = 0; b < nBeam; ++b) {
+                tasks.run([&, b]() {
+                    const uint64_t *board = &beamBoards[b*dimZ];
+                    if (beam[b].over) {
+                        // the game ended, nothing to place
+                        children[b].push_back(beam[b]);
+                        childBoards[b].assign(board, board + dimZ);
+                        return;
+                    }
+                    if (hasDeadline && Clock::now() >= deadline) {
+                        cutOff = true;
+                        return;
+                    }
+                    expand(localContext(), board, beam[b], pieces[depth], pieces[depth + 1],
+                        children[b], childBoards[b]);
+                });
+            }
+            tasks.wait();
+        }
+        if (cutOff) break;
+
+        std::vector<Node> nextBeam;
+        std::vector<uint64_t> nextBoards;
+        for (int b = 0; b < nBeam; ++b) {
+            nextBeam.insert(nextBeam.end(), children[b].begin(), children[b].end());
+            nextBoards.insert(nextBoards.end(), childBoards[b].begin(), childBoards[b].end());
+        }
+        lastEvaluated += static_cast<long>(nextBeam.size());
+        if (nextBeam.empty()) break;
+
+        selectBeam(nextBeam, nextBoards);
+        beam.swap(nextBeam);
+        beamBoards.swap(nextBoards);
+        best = beam[0].rootPlacement;
+        lastDepth = depth + 1;
+    }
+
+    rootContext.generator.getInputs(rootContext.generator.getPlacements()[best], result);
+    return true;
+}
+
+bool Autoplayer::play(Game &game, int budgetMs) {
+    if (game.isOver()) return false;
+    game.snapshot(*state);
+    inputs.clear();
+    if (!chooseInputs(*state, budgetMs, inputs)) return false;
+    for (PlacementInput input : inputs) placements::applyInput(game, input);
+    return true;
+}
@@ -0,0 +1,279 @@
+#include "board-features.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <assert.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BOARD_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+const int BoardFeatureExtractor::MAX_COLUMNS;
+const int FeatureWeights::N_WEIGHTS;
+
+namespace {
+    template <class W>
+    auto &weightAt(W &w, int i) {
+        switch (i) {
+        case 0: return w.holes;
+        case 1: return w.aggregateHeight;
+        case 2: return w.maxHeight;
+        case 3: return w.bumpiness;
+        case 4: return w.wellDepth;
+        case 5: return w.maxWellDepth;
+        case 6: return w.nearFullLayers;
+        case 7: return w.removedLayers;
+        default: abort();
+        }
+    }
+}
+
+double &FeatureWeights::operator[](int i) {
+    return weightAt(*this, i);
+}
+
+double FeatureWeights::operator[](int i) const {
+    return weightAt(*this, i);
+}
+
+double evaluate(const BoardFeatures &f, int nRemovedLayers, const FeatureWeights &w) {
+    return w.holes*f.holes +
+        w.aggregateHeight*f.aggregateHeight +
+        w.maxHeight*f.maxHeight +
+        w.bumpiness*f.bumpiness +
+        w.wellDepth*f.wellDepth +
+        w.maxWellDepth*f.maxWellDepth +
+        w.nearFullLayers*f.nearFullLayers +
+        w.removedLayers*nRemovedLayers;
+}
+
+namespace board_features {
+    // column heights are stored with this much zero padding on both sides
+    // so that the neighbor loads stay inside the buffer
+    const int PAD = BoardFeatureExtractor::MAX_COLUMNS;
+    const int BUFFER_SIZE = 3*PAD;
+
+    // one pass over the layers from the top down. Fills the column heights
+    // and the per-layer features
+    inline __attribute__((always_inline))
+    void layerPass(const uint64_t *layers, int nLayers, uint64_t fullLayer,
+        int32_t *heights, BoardFeatures &f)
+    {
+        f.nBlocks = f.holes = f.fullLayers = f.nearFullLayers = 0;
+        uint64_t above = 0;
+        for (int z = nLayers - 1; z >= 0; --z) {
+            const uint64_t layer = layers[z];
+            const int nEmpty = __builtin_popcountll(fullLayer & ~layer);
+            f.nBlocks += __builtin_popcountll(layer);
+            f.holes += __builtin_popcountll(above & ~layer);
+            f.fullLayers += nEmpty == 0;
+            f.nearFullLayers += nEmpty == 1 || nEmpty == 2;
+
+            for (uint64_t top = layer & ~above; top != 0; top &= top - 1) {
+                heights[__builtin_ctzll(top)] = z + 1;
+            }
+            above |= layer;
+        }
+    }
+
+    struct ColumnMasks {
+        const int32_t *hasLeft, *hasRight, *hasDown, *hasUp, *isColumn;
+    };
+
+    void columnPassScalar(const int32_t *h, int nColumns, int rowSize, int wall,
+        const ColumnMasks &m, BoardFeatures &f)
+    {
+        f.aggregateHeight = f.maxHeight = f.bumpiness = f.wellDepth = f.maxWellDepth = 0;
+        for (int i = 0; i < nColumns; ++i) {
+            f.aggregateHeight += h[i];
+            f.maxHeight = std::max(f.maxHeight, h[i]);
+            if (m.hasRight[i]) f.bumpiness += std::abs(h[i] - h[i + 1]);
+            if (m.hasUp[i]) f.bumpiness += std::abs(h[i] - h[i + rowSize]);
+
+            const int lowest = std::min(
+                std::min(m.hasLeft[i] ? h[i - 1] : wall, m.hasRight[i] ? h[i + 1] : wall),
+                std::min(m.hasDown[i] ? h[i - rowSize] : wall, m.hasUp[i] ? h[i + rowSize] : wall));
+            const int depth = std::max(lowest - h[i], 0);
+            f.wellDepth += depth;
+            f.maxWellDepth = std::max(f.maxWellDepth, depth);
+        }
+    }
+
+#ifdef BOARD_FEATURES_X86
+    __attribute__((target("sse4.1,popcnt")))
+    int horizontalSum(__m128i v) {
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(v);
+    }
+
+    __attribute__((target("sse4.1,popcnt")))
+    int horizontalMax(__m128i v) {
+        v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+        v = _mm_max_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(v);
+    }
+
+    __attribute__((target("sse4.1,popcnt")))
+    void computeSse41(const uint64_t *layers, Pos3d dims, uint64_t fullLayer,
+        const ColumnMasks &m, BoardFeatures &f)
+    {
+        alignas(32) int32_t buffer[BUFFER_SIZE] = {};
+        int32_t *h = buffer + PAD;
+        layerPass(layers, dims.z, fullLayer, h, f);
+
+        const __m128i wall = _mm_set1_epi32(dims.z), zero = _mm_setzero_si128();
+        __m128i sum = zero, maxHeight = zero, bumpiness = zero, wells = zero, maxWell = zero;
+        const int nColumns = dims.x*dims.y;
+        for (int i = 0; i < nColumns; i += 4) {
+            const __m128i hasLeft = _mm_loadu_si128((const __m128i*)(m.hasLeft + i));
+            const __m128i hasRight = _mm_loadu_si128((const __m128i*)(m.hasRight + i));
+            const __m128i hasDown = _mm_loadu_si128((const __m128i*)(m.hasDown + i));
+            const __m128i hasUp = _mm_loadu_si128((const __m128i*)(m.hasUp + i));
+            const __m128i isColumn = _mm_loadu_si128((const __m128i*)(m.isColumn + i));
+
+            const __m128i c = _mm_load_si128((const __m128i*)(h + i));
+            const __m128i left = _mm_loadu_si128((const __m128i*)(h + i - 1));
+            const __m128i right = _mm_loadu_si128((const __m128i*)(h + i + 1));
+            const __m128i down = _mm_loadu_si128((const __m128i*)(h + i - dims.x));
+            const __m128i up = _mm_loadu_si128((const __m128i*)(h + i + dims.x));
+
+            sum = _mm_add_epi32(sum, c);
+            maxHeight = _mm_max_epi32(maxHeight, c);
+            bumpiness = _mm_add_epi32(bumpiness, _mm_add_epi32(
+                _mm_and_si128(_mm_abs_epi32(_mm_sub_epi32(c, right)), hasRight),
+                _mm_and_si128(_mm_abs_epi32(_mm_sub_epi32(c, up)), hasUp)));
+
+            const __m128i lowest = _mm_min_epi32(
+                _mm_min_epi32(_mm_blendv_epi8(wall, left, hasLeft), _mm_blendv_epi8(wall, right, hasRight)),
+                _mm_min_epi32(_mm_blendv_epi8(wall, down, hasDown), _mm_blendv_epi8(wall, up, hasUp)));
+            const __m128i depth = _mm_and_si128(_mm_max_epi32(_mm_sub_epi32(lowest, c), zero), isColumn);
+            wells = _mm_add_epi32(wells, depth);
+            maxWell = _mm_max_epi32(maxWell, depth);
+        }
+
+        f.aggregateHeight = horizontalSum(sum);
+        f.maxHeight = horizontalMax(maxHeight);
+        f.bumpiness = horizontalSum(bumpiness);
+        f.wellDepth = horizontalSum(wells);
+        f.maxWellDepth = horizontalMax(maxWell);
+    }
+
+    __attribute__((target("avx2,popcnt")))
+    void computeAvx2(const uint64_t *layers, Pos3d dims, uint64_t fullLayer,
+        const ColumnMasks &m, BoardFeatures &f)
+    {
+        alignas(32) int32_t buffer[BUFFER_SIZE] = {};
+        int32_t *h = buffer + PAD;
+        layerPass(layers, dims.z, fullLayer, h, f);
+
+        const __m256i wall = _mm256_set1_epi32(dims.z), zero = _mm256_setzero_si256();
+        __m256i sum = zero, maxHeight = zero, bumpiness = zero, wells = zero, maxWell = zero;
+        const int nColumns = dims.x*dims.y;
+        for (int i = 0; i < nColumns; i += 8) {
+            const __m256i hasLeft = _mm256_loadu_si256((const __m256i*)(m.hasLeft + i));
+            const __m256i hasRight = _mm256_loadu_si256((const __m256i*)(m.hasRight + i));
+            const __m256i hasDown = _mm256_loadu_si256((const __m256i*)(m.hasDown + i));
+            const __m256i hasUp = _mm256_loadu_si256((const __m256i*)(m.hasUp + i));
+            const __m256i isColumn = _mm256_loadu_si256((const __m256i*)(m.isColumn + i));
+
+            const __m256i c = _mm256_load_si256((const __m256i*)(h + i));
+            const __m256i left = _mm256_loadu_si256((const __m256i*)(h + i - 1));
+            const __m256i right = _mm256_loadu_si256((const __m256i*)(h + i + 1));
+            const __m256i down = _mm256_loadu_si256((const __m256i*)(h + i - dims.x));
+            const __m256i up = _mm256_loadu_si256((const __m256i*)(h + i + dims.x));
+
+            sum = _mm256_add_epi32(sum, c);
+            maxHeight = _mm256_max_epi32(maxHeight, c);
+            bumpiness = _mm256_add_epi32(bumpiness, _mm256_add_epi32(
+                _mm256_and_si256(_mm256_abs_epi32(_mm256_sub_epi32(c, right)), hasRight),
+                _mm256_and_si256(_mm256_abs_epi32(_mm256_sub_epi32(c, up)), hasUp)));
+
+            const __m256i lowest = _mm256_min_epi32(
+                _mm256_min_epi32(_mm256_blendv_epi8(wall, left, hasLeft), _mm256_blendv_epi8(wall, right, hasRight)),
+                _mm256_min_epi32(_mm256_blendv_epi8(wall, down, hasDown), _mm256_blendv_epi8(wall, up, hasUp)));
+            const __m256i depth = _mm256_and_si256(_mm256_max_epi32(_mm256_sub_epi32(lowest, c), zero), isColumn);
+            wells = _mm256_add_epi32(wells, depth);
+            maxWell = _mm256_max_epi32(maxWell, depth);
+        }
+
+        const __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        const __m128i bump4 = _mm_add_epi32(_mm256_castsi256_si128(bumpiness), _mm256_extracti128_si256(bumpiness, 1));
+        const __m128i wells4 = _mm_add_epi32(_mm256_castsi256_si128(wells), _mm256_extracti128_si256(wells, 1));
+        const __m128i maxHeight4 = _mm_max_epi32(_mm256_castsi256_si128(maxHeight), _mm256_extracti128_si256(maxHeight, 1));
+        const __m128i maxWell4 = _mm_max_epi32(_mm256_castsi256_si128(maxWell), _mm256_extracti128_si256(maxWell, 1));
+
+        f.aggregateHeight = horizontalSum(sum4);
+        f.maxHeight = horizontalMax(maxHeight4);
+        f.bumpiness = horizontalSum(bump4);
+        f.wellDepth = horizontalSum(wells4);
+        f.maxWellDepth = horizontalMax(maxWell4);
+    }
+#endif
+
+    void computeScalar(const uint64_t *layers, Pos3d dims, uint64_t fullLayer,
+        const ColumnMasks &m, BoardFeatures &f)
+    {
+        int32_t buffer[BUFFER_SIZE] = {};
+        int32_t *h = buffer + PAD;
+        layerPass(layers, dims.z, fullLayer, h, f);
+        columnPassScalar(h, dims.x*dims.y, dims.x, dims.z, m, f);
+    }
+}
+
+BoardFeatureExtractor::Simd BoardFeatureExtractor::bestSimd() {
+#ifdef BOARD_FEATURES_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) return Simd::AVX2;
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("popcnt")) return Simd::SSE41;
+#endif
+    return Simd::SCALAR;
+}
+
+BoardFeatureExtractor::BoardFeatureExtractor(Pos3d dimensions, Simd simd_)
+:
+    dims(dimensions),
+    simd(simd_),
+    fullLayer(dims.x*dims.y == MAX_COLUMNS ?
+        ~uint64_t(0) : (uint64_t(1) << (dims.x*dims.y)) - 1)
+{
+    assert( dims.x*dims.y <= MAX_COLUMNS );
+#ifndef BOARD_FEATURES_X86
+    // no SIMD implementations on this platform
+    if (simd != Simd::SCALAR) abort();
+#endif
+
+    for (int i = 0; i < MAX_COLUMNS; ++i) {
+        const int x = i % dims.x, y = i / dims.x;
+        const bool inside = y < dims.y;
+        hasLeft[i] = inside && x > 0 ? -1 : 0;
+        hasRight[i] = inside && x < dims.x - 1 ? -1 : 0;
+        hasDown[i] = inside && y > 0 ? -1 : 0;
+        hasUp[i] = inside && y < dims.y - 1 ? -1 : 0;
+        isColumn[i] = inside ? -1 : 0;
+    }
+}
+
+BoardFeatures BoardFeatureExtractor::compute(const uint64_t *layers) const {
+    BoardFeatures features;
+    computeBatch(layers, 1, &features);
+    return features;
+}
+
+void BoardFeatureExtractor::computeBatch(const uint64_t *layers, int nBoards, BoardFeatures *out) const {
+    using namespace board_features;
+    const ColumnMasks masks { hasLeft, hasRight, hasDown, hasUp, isColumn };
+
+    switch (simd) {
+#ifdef BOARD_FEATURES_X86
+    case Simd::AVX2:
+        for (int b = 0; b < nBoards; ++b) computeAvx2(layers + b*dims.z, dims, fullLayer, masks, out[b]);
+        break;
+    case Simd::SSE41:
+        for (int b = 0; b < nBoards; ++b) computeSse41(layers + b*dims.z, dims, fullLayer, masks, out[b]);
+        break;
+#endif
+    default:
+        for (int b = 0; b < nBoards; ++b) computeScalar(layers + b*dims.z, dims, fullLayer, masks, out[b]);
+        break;
+    }
+}
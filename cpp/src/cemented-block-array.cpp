@@ -1,19 +1,55 @@
 #include "cemented-block-array.hpp"
+#include "piece-shapes.hpp"
+#include "zobrist.hpp"
+#include <algorithm>
+#include <cstdlib>
 #include <assert.h>
 
+namespace cemented_block_array {
+    const int MAX_LAYER_SIZE = 64;
+
+    LayerMask fullLayerMask(Pos3d dims) {
+        const int layerSize = dims.x*dims.y;
+        assert( layerSize <= MAX_LAYER_SIZE );
+        if (layerSize == MAX_LAYER_SIZE) return ~LayerMask(0);
+        return (LayerMask(1) << layerSize) - 1;
+    }
+}
+
+const int CementedBlockArray::JOURNAL_CAPACITY;
+
 CementedBlockArray::CementedBlockArray(const GameBox& gameBox)
 :
-    box(gameBox),
-    nonEmpty(gameBox.size()),
-    blockPieceIds(gameBox.size())
-{}
+    dims(gameBox.dims),
+    fullLayer(cemented_block_array::fullLayerMask(dims)),
+    layers(dims.z),
+    blockPieceIds(dims.z*dims.x*dims.y),
+    shapeMasks(piece_shapes::buildShapeMasks(dims)),
+    columnHeights(dims.y*dims.x),
+    cellKeys(dims.z*dims.x*dims.y),
+    zobristKey(0),
+    journal(JOURNAL_CAPACITY)
+{
+    for (int cell = 0; cell < static_cast<int>(cellKeys.size()); ++cell)
+        cellKeys[cell] = zobrist::cellKey(cell);
+}
+
+bool CementedBlockArray::contains(Pos3d p) const {
+    return p.x >= 0 && p.x < dims.x &&
+        p.y >= 0 && p.y < dims.y &&
+        p.z >= 0 && p.z < dims.z;
+}
 
 int CementedBlockArray::posToIndex(Pos3d pos) const {
-    return pos.z*box.dims.x*box.dims.y + pos.y*box.dims.x + pos.x;
+    return pos.z*dims.x*dims.y + posToBitIndex(pos);
+}
+
+int CementedBlockArray::posToBitIndex(Pos3d pos) const {
+    return pos.y*dims.x + pos.x;
 }
 
-void CementedBlockArray::clearBlock(Pos3d pos) {
-    nonEmpty[posToIndex(pos)] = false;
+LayerMask CementedBlockArray::posToBit(Pos3d pos) const {
+    return LayerMask(1) << posToBitIndex(pos);
 }
 
 int CementedBlockArray::getBlockPieceId(Pos3d pos) const {
@@ -22,56 +58,172 @@ int CementedBlockArray::getBlockPieceId(Pos3d pos) const {
 }
 
 void CementedBlockArray::setBlock(const Block &block) {
-    assert( box.contains(block.pos) );
+    assert( contains(block.pos) );
 
-    int idx = posToIndex(block.pos);
-    nonEmpty[idx] = true;
-    blockPieceIds[idx] = block.pieceId;
+    if (!hasBlock(block.pos)) zobristKey ^= cellKeys[posToIndex(block.pos)];
+    layers[block.pos.z] |= posToBit(block.pos);
+    blockPieceIds[posToIndex(block.pos)] = block.pieceId;
+
+    int &height = columnHeights[posToBitIndex(block.pos)];
+    height = std::max(height, block.pos.z + 1);
+
+    journal.blockSet(block);
 }
 
 bool CementedBlockArray::hasBlock(Pos3d pos) const {
-    assert( box.contains(pos) );
-    return nonEmpty[posToIndex(pos)];
+    assert( contains(pos) );
+    return (layers[pos.z] & posToBit(pos)) != 0;
 }
 
 bool CementedBlockArray::isLayerFull(int z) const {
-    for (int x = 0; x < box.dims.x; ++x) {
-        for (int y = 0; y < box.dims.y; ++y) {
-            if (!hasBlock(Pos3d {x,y,z})) return false;
+    return layers[z] == fullLayer;
+}
+
+void CementedBlockArray::removeLayer(int z) {
+    const int layerSize = dims.x*dims.y;
+
+    // the layers above move down by one
+    for (int i = z; i < dims.z; ++i) zobristKey ^= layerKey(layers[i], i);
+    std::copy(layers.begin() + z + 1, layers.end(), layers.begin() + z);
+    layers.back() = 0;
+    for (int i = z; i < dims.z - 1; ++i) zobristKey ^= layerKey(layers[i], i);
+
+    std::copy(
+        blockPieceIds.begin() + (z + 1)*layerSize,
+        blockPieceIds.end(),
+        blockPieceIds.begin() + z*layerSize);
+
+    updateColumnHeights();
+    journal.layerRemoved(z);
+}
+
+int CementedBlockArray::removeFullLayers() {
+    const int layerSize = dims.x*dims.y;
+
+    // journal removals top-down so that they can be applied one by one
+    for (int z = dims.z - 1; z >= 0; --z) {
+        if (layers[z] == fullLayer) journal.layerRemoved(z);
+    }
+
+    // compact the remaining layers downwards, keeping their order
+    int dst = 0;
+    for (int z = 0; z < dims.z; ++z) {
+        if (layers[z] == fullLayer) {
+            zobristKey ^= layerKey(layers[z], z);
+            continue;
+        }
+        if (dst != z) {
+            zobristKey ^= layerKey(layers[z], z) ^ layerKey(layers[z], dst);
+            layers[dst] = layers[z];
+            std::copy(
+                blockPieceIds.begin() + z*layerSize,
+                blockPieceIds.begin() + (z + 1)*layerSize,
+                blockPieceIds.begin() + dst*layerSize);
         }
+        dst++;
     }
-    return true;
+    std::fill(layers.begin() + dst, layers.end(), 0);
+
+    const int nRemoved = dims.z - dst;
+    if (nRemoved > 0) updateColumnHeights();
+    return nRemoved;
 }
 
-void CementedBlockArray::removeLayer(int zToRemove) {
-    for (int z = zToRemove; z < box.dims.z; ++z) {
-        for (int x = 0; x < box.dims.x; ++x) {
-            for (int y = 0; y < box.dims.y; ++y) {
-                const Pos3d pos {x,y,z}, top {x,y,z+1};
-                if (z == box.dims.z-1 || !hasBlock(top)) clearBlock(pos);
-                else setBlock(Block{pos, getBlockPieceId(top)});
-            }
+void CementedBlockArray::updateColumnHeights() {
+    std::fill(columnHeights.begin(), columnHeights.end(), 0);
+
+    // from the top down, each column gets its height from the first
+    // layer where its bit is set
+    LayerMask done = 0;
+    for (int z = dims.z - 1; z >= 0 && done != fullLayer; --z) {
+        for (LayerMask rest = layers[z] & ~done; rest != 0; rest &= rest - 1) {
+            columnHeights[__builtin_ctzll(rest)] = z + 1;
         }
+        done |= layers[z];
     }
 }
 
+uint64_t CementedBlockArray::layerKey(LayerMask layer, int keyZ) const {
+    const uint64_t *keys = &cellKeys[keyZ*dims.x*dims.y];
+    uint64_t key = 0;
+    for (LayerMask rest = layer; rest != 0; rest &= rest - 1) key ^= keys[__builtin_ctzll(rest)];
+    return key;
+}
+
+int CementedBlockArray::getColumnHeight(int x, int y) const {
+    assert( contains(Pos3d { x, y, 0 }) );
+    return columnHeights[posToBitIndex(Pos3d { x, y, 0 })];
+}
+
+int CementedBlockArray::dropDistance(const Piece& piece) const {
+    assert( pieceFits(piece) );
+
+    int distance = dims.z;
+    for (Block b : piece.getBlocks()) {
+        const int height = columnHeights[posToBitIndex(b.pos)];
+        if (b.pos.z < height) {
+            // below an overhang: the column height map is not enough
+            Piece moved = piece;
+            distance = 0;
+            do {
+                moved = moved.translated(Pos3d { 0, 0, -1 });
+                distance++;
+            } while (pieceFits(moved));
+            return distance - 1;
+        }
+        distance = std::min(distance, b.pos.z - height);
+    }
+    return distance;
+}
+
+void CementedBlockArray::saveTo(GameState &state) const {
+    assert( dims.z <= GameState::MAX_HEIGHT );
+    assert( dims.z*dims.y*dims.x <= GameState::MAX_CELLS );
+
+    state.dimensions = dims;
+    std::copy(layers.begin(), layers.end(), state.layers);
+    std::copy(blockPieceIds.begin(), blockPieceIds.end(), state.pieceIds);
+}
+
+void CementedBlockArray::restoreFrom(const GameState &state) {
+    const Pos3d d = state.dimensions;
+    if (d.x != dims.x || d.y != dims.y || d.z != dims.z) abort();
+
+    std::copy(state.layers, state.layers + dims.z, layers.begin());
+    std::copy(state.pieceIds, state.pieceIds + blockPieceIds.size(), blockPieceIds.begin());
+    zobristKey = 0;
+    for (int z = 0; z < dims.z; ++z) zobristKey ^= layerKey(layers[z], z);
+
+    updateColumnHeights();
+    journal.discardHistory();
+}
+
 std::vector<Block> CementedBlockArray::getNonEmptyBlocks() const {
     std::vector<Block>  blocks;
-    for (int z = 0; z < box.dims.z; ++z) {
-        for (int y = 0; y < box.dims.y; ++y) {
-            for (int x = 0; x < box.dims.x; ++x) {
-                const Pos3d pos {x,y,z};
-                if (hasBlock(pos))
-                    blocks.push_back(Block{pos, getBlockPieceId(pos)});
-            }
+    forEachNonEmptyBlock([&blocks](const Block &b) { blocks.push_back(b); });
+    return blocks;
+}
+
+void CementedBlockArray::forEachNonEmptyBlock(const BlockCallback& callback) const {
+    for (int z = 0; z < dims.z; ++z) {
+        // bits are in y-major order, iterate from the lowest set bit
+        for (LayerMask rest = layers[z]; rest != 0; rest &= rest - 1) {
+            const int bit = __builtin_ctzll(rest);
+            const Pos3d pos { bit % dims.x, bit / dims.x, z };
+            callback(Block{pos, blockPieceIds[posToIndex(pos)]});
         }
     }
-    return blocks;
 }
 
 bool CementedBlockArray::pieceFits(const Piece& piece) const {
+    if (piece.getShape() == Piece::NO_SHAPE) return blocksFit(piece);
+
+    return piece_shapes::shapeFits(shapeMasks[piece.getShape()], piece.getCenter(), dims, layers.data());
+}
+
+bool CementedBlockArray::blocksFit(const Piece& piece) const {
     for (Block b : piece.getBlocks()) {
-        if (!box.contains(b.pos) || hasBlock(b.pos)) return false;
+        if (!contains(b.pos) || hasBlock(b.pos)) return false;
     }
     return true;
 }
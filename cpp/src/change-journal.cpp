@@ -0,0 +1,39 @@
+#include "change-journal.hpp"
+#include <assert.h>
+
+ChangeJournal::ChangeJournal(int capacity)
+:
+    entries(capacity),
+    version(0),
+    historyStart(0)
+{
+    assert(capacity > 0);
+}
+
+void ChangeJournal::record(ChangeType type, const Block &block) {
+    version++;
+    entries[version % entries.size()] = CementedChange { version, type, block };
+}
+
+void ChangeJournal::blockSet(const Block &block) {
+    record(ChangeType::BLOCK_SET, block);
+}
+
+void ChangeJournal::layerRemoved(int z) {
+    record(ChangeType::LAYER_REMOVED, Block { Pos3d { 0, 0, z }, 0 });
+}
+
+void ChangeJournal::discardHistory() {
+    version++;
+    historyStart = version;
+}
+
+bool ChangeJournal::getChangesSince(unsigned int sinceVersion, std::vector<CementedChange> &out) const {
+    if (sinceVersion > version || sinceVersion < historyStart) return false;
+    if (version - sinceVersion > entries.size()) return false;
+
+    for (unsigned int v = sinceVersion + 1; v <= version; ++v) {
+        out.push_back(entries[v % entries.size()]);
+    }
+    return true;
+}
@@ -0,0 +1,262 @@
+#include "expectimax.hpp"
+#include "game-config.hpp"
+#include "piece-shapes.hpp"
+#include "zobrist.hpp"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <assert.h>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // below any board evaluation but finite so that it can be averaged
+    const double GAME_OVER_VALUE = -1e6;
+    // enough for the chance nodes of a depth 2 search without evictions
+    const std::size_t MEMO_ENTRIES = 1 << 16;
+
+    // points from removing the layers with one piece, see ConcreteGame::moveDown
+    double removalScore(int nRemoved) {
+        return ((1 << nRemoved) - 1) * game_config::REMOVAL_SCORE_MULTIPLIER;
+    }
+}
+
+ExpectimaxSearch::Level::Level(Pos3d dims)
+:
+    generator(dims),
+    state(new GameState())
+{
+    state->dimensions = dims;
+    state->alive = true;
+}
+
+ExpectimaxSearch::Context::Context(Pos3d dims, int nLevels)
+:
+    extractor(dims),
+    nNodes(0),
+    nEvaluations(0),
+    nMemoHits(0)
+{
+    for (int i = 0; i < nLevels; ++i) levels.emplace_back(new Level(dims));
+}
+
+ExpectimaxSearch::ExpectimaxSearch(Pos3d dims, WorkStealingPool &pool, int depth, int maxCandidates)
+:
+    gameBox(dims),
+    pool(pool),
+    depth(depth),
+    maxCandidates(maxCandidates),
+    rootContext(dims, depth + 1),
+    memo(MEMO_ENTRIES),
+    state(new GameState())
+{
+    using piece_shapes::TABLE;
+    assert( depth >= 0 && maxCandidates > 0 );
+
+    // same as PieceGenerator::nextPiece
+    for (int proto = 0; proto < piece_shapes::N_PROTOTYPES; ++proto) {
+        const int shape = TABLE.first[proto];
+        spawnShapes.push_back(shape);
+        spawnCenters.push_back(gameBox.translateToBounds(shape,
+            Pos3d { dims.x/2, dims.y/2, dims.z + 5 }));
+    }
+
+    for (int i = 0; i <= pool.getThreadCount(); ++i) {
+        contexts.emplace_back(new Context(dims, depth + 1));
+    }
+}
+
+ExpectimaxSearch::Context &ExpectimaxSearch::localContext() {
+    const int worker = pool.getWorkerIndex();
+    assert( worker >= 0 || std::this_thread::get_id() == searchThread );
+    return *contexts[worker < 0 ? pool.getThreadCount() : worker];
+}
+
+uint64_t ExpectimaxSearch::boardKey(const uint64_t *board) const {
+    return zobrist::boardKey(board, gameBox.dims);
+}
+
+int ExpectimaxSearch::expand(Context &context, int levelIndex, const uint64_t *board, int shape, Pos3d center) {
+    const int dimZ = gameBox.dims.z;
+    Level &level = *context.levels[levelIndex];
+    std::copy(board, board + dimZ, level.state->layers);
+    level.state->activeShape = shape;
+    level.state->activeCenter = center;
+
+    const std::vector<Placement> &placements = level.generator.generate(*level.state);
+    const int n = static_cast<int>(placements.size());
+    level.boards.resize(n*dimZ);
+    level.nRemoved.resize(n);
+    level.features.resize(n);
+    level.values.resize(n);
+    level.hashes.resize(n);
+    for (int i = 0; i < n; ++i) {
+        uint64_t *child = &level.boards[i*dimZ];
+        std::copy(board, board + dimZ, child);
+        level.nRemoved[i] = level.generator.place(placements[i], child);
+        level.hashes[i] = boardKey(child);
+    }
+    context.extractor.computeBatch(level.boards.data(), n, level.features.data());
+    context.nEvaluations += n;
+    for (int i = 0; i < n; ++i) {
+        level.values[i] = Value {
+            evaluate(level.features[i], level.nRemoved[i], weights),
+            removalScore(level.nRemoved[i])
+        };
+    }
+
+    // best first. Equal boards have equal values and hashes, so they end up
+    // next to each other and only the first is kept
+    level.order.resize(n);
+    std::iota(level.order.begin(), level.order.end(), 0);
+    std::sort(level.order.begin(), level.order.end(), [&level](int a, int b) {
+        if (level.values[a].value != level.values[b].value)
+            return level.values[a].value > level.values[b].value;
+        if (level.hashes[a] != level.hashes[b]) return level.hashes[a] < level.hashes[b];
+        return a < b;
+    });
+    int nUnique = 0;
+    for (int i = 0; i < n; ++i) {
+        const int child = level.order[i];
+        if (nUnique > 0 && level.hashes[level.order[nUnique - 1]] == level.hashes[child]) continue;
+        level.order[nUnique++] = child;
+    }
+    level.order.resize(nUnique);
+    return nUnique;
+}
+
+ExpectimaxSearch::Value ExpectimaxSearch::maxNode(Context &context, int levelIndex,
+    const uint64_t *board, int shape, Pos3d center, int pliesLeft)
+{
+    context.nNodes++;
+    const int n = expand(context, levelIndex, board, shape, center);
+    // the piece does not fit, the game ends
+    if (n == 0) return Value { GAME_OVER_VALUE, 0 };
+
+    const Level &level = *context.levels[levelIndex];
+    if (pliesLeft == 0) return level.values[level.order[0]];
+
+    Value best { -std::numeric_limits<double>::infinity(), 0 };
+    const int nCandidates = std::min(n, maxCandidates);
+    for (int i = 0; i < nCandidates; ++i) {
+        const int child = level.order[i];
+        const Value future = chanceNode(context, levelIndex, &level.boards[child*gameBox.dims.z], pliesLeft);
+        const Value v {
+            weights.removedLayers*level.nRemoved[child] + future.value,
+            removalScore(level.nRemoved[child]) + future.score
+        };
+        if (v.value > best.value) best = v;
+    }
+    return best;
+}
+
+ExpectimaxSearch::Value ExpectimaxSearch::chanceNode(Context &context, int levelIndex,
+    const uint64_t *board, int pliesLeft)
+{
+    context.nNodes++;
+    const uint64_t key = boardKey(board) ^ (uint64_t(pliesLeft) * 0x9e3779b97f4a7c15ull);
+    Value result;
+    if (memo.find(key, result)) {
+        context.nMemoHits++;
+        return result;
+    }
+
+    result = Value { 0, 0 };
+    for (int proto = 0; proto < piece_shapes::N_PROTOTYPES; ++proto) {
+        const Value v = maxNode(context, levelIndex + 1, board,
+            spawnShapes[proto], spawnCenters[proto], pliesLeft - 1);
+        result.value += v.value / piece_shapes::N_PROTOTYPES;
+        result.score += v.score / piece_shapes::N_PROTOTYPES;
+    }
+    // deeper values cost more to recompute
+    memo.store(key, result, pliesLeft);
+    return result;
+}
+
+ExpectimaxSearch::Result ExpectimaxSearch::search(const GameState &current) {
+    const auto start = Clock::now();
+    const int dimZ = gameBox.dims.z;
+    const int N_PROTOTYPES = piece_shapes::N_PROTOTYPES;
+
+    memo.newGeneration();
+    searchThread = std::this_thread::get_id();
+    rootContext.nNodes = rootContext.nEvaluations = rootContext.nMemoHits = 0;
+    for (auto &c : contexts) c->nNodes = c->nEvaluations = c->nMemoHits = 0;
+
+    Result result;
+    result.found = false;
+    result.value = result.expectedScore = 0;
+    int n = 0;
+    if (current.alive) {
+        rootContext.nNodes++;
+        n = expand(rootContext, 0, current.layers, current.activeShape, current.activeCenter);
+    }
+    const Level &root = *rootContext.levels[0];
+
+    if (n > 0) {
+        // the root chance nodes of the candidates, one task per prototype
+        const int nCandidates = depth == 0 ? 1 : std::min(n, maxCandidates);
+        std::vector<Value> futures(nCandidates*N_PROTOTYPES, Value { 0, 0 });
+        if (depth > 0) {
+            TaskGroup tasks(pool);
+            for (int i = 0; i < nCandidates; ++i) {
+                for (int proto = 0; proto < N_PROTOTYPES; ++proto) {
+                    tasks.run([&, i, proto]() {
+                        const uint64_t *board = &root.boards[root.order[i]*dimZ];
+                        futures[i*N_PROTOTYPES + proto] = maxNode(localContext(), 1, board,
+                            spawnShapes[proto], spawnCenters[proto], depth - 1);
+                    });
+                }
+            }
+            tasks.wait();
+            rootContext.nNodes += nCandidates;
+        }
+
+        int best = -1;
+        for (int i = 0; i < nCandidates; ++i) {
+            const int child = root.order[i];
+            Value v = root.values[child];
+            if (depth > 0) {
+                v = Value { weights.removedLayers*root.nRemoved[child], removalScore(root.nRemoved[child]) };
+                for (int proto = 0; proto < N_PROTOTYPES; ++proto) {
+                    v.value += futures[i*N_PROTOTYPES + proto].value / N_PROTOTYPES;
+                    v.score += futures[i*N_PROTOTYPES + proto].score / N_PROTOTYPES;
+                }
+            }
+            if (best < 0 || v.value > result.value) {
+                best = child;
+                result.value = v.value;
+                result.expectedScore = v.score;
+            }
+        }
+        result.found = true;
+        result.placement = root.generator.getPlacements()[best];
+    }
+
+    result.nNodes = rootContext.nNodes;
+    result.nEvaluations = rootContext.nEvaluations;
+    result.nMemoHits = rootContext.nMemoHits;
+    for (const auto &c : contexts) {
+        result.nNodes += c->nNodes;
+        result.nEvaluations += c->nEvaluations;
+        result.nMemoHits += c->nMemoHits;
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return result;
+}
+
+void ExpectimaxSearch::getInputs(const Placement &placement, std::vector<PlacementInput> &result) {
+    rootContext.levels[0]->generator.getInputs(placement, result);
+}
+
+bool ExpectimaxSearch::play(Game &game) {
+    if (game.isOver()) return false;
+    game.snapshot(*state);
+    const Result result = search(*state);
+    if (!result.found) return false;
+    inputs.clear();
+    getInputs(result.placement, inputs);
+    for (PlacementInput input : inputs) placements::applyInput(game, input);
+    return true;
+}
@@ -0,0 +1,284 @@
+#include "game-batch.hpp"
+#include "game-config.hpp"
+#include "piece-shapes.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <assert.h>
+
+namespace game_batch {
+    const int MAX_LAYER_SIZE = 64;
+    static_assert(GameState::MAX_HEIGHT <= 32, "full layers are uint32_t bit masks");
+
+    // same as in game.cpp: other dimensions would overflow the layer
+    // masks, the full layer bits and the snapshots
+    Pos3d checkedDimensions(Pos3d dims) {
+        if (!GameState::isSupported(dims)) abort();
+        return dims;
+    }
+
+    GameBatch::LayerMask fullLayerMask(int layerSize) {
+        return layerSize == MAX_LAYER_SIZE ?
+            ~GameBatch::LayerMask(0) : (GameBatch::LayerMask(1) << layerSize) - 1;
+    }
+}
+
+GameBatch::GameBatch(const std::vector<unsigned int> &randomSeeds, Pos3d dims)
+:
+    gameBox(game_batch::checkedDimensions(dims)),
+    nGames(static_cast<int>(randomSeeds.size())),
+    layerSize(dims.x*dims.y),
+    fullLayer(game_batch::fullLayerMask(dims.x*dims.y)),
+    shapeMasks(piece_shapes::buildShapeMasks(dims)),
+    layers(dims.z*nGames, 0),
+    pieceIds(dims.z*dims.y*dims.x*nGames, 0),
+    activeShape(nGames),
+    activeX(nGames), activeY(nGames), activeZ(nGames),
+    activePieceId(nGames),
+    score(nGames, 0),
+    alive(nGames, 1),
+    timeMs(nGames, 0),
+    timeToNextDownMs(nGames, game_config::DROP_INTERVAL_MS),
+    nDroppedPieces(nGames, 0),
+    landed(nGames, 0),
+    fullLayers(nGames, 0)
+{
+    pieceGenerators.reserve(nGames);
+    for (int game = 0; game < nGames; ++game) {
+        pieceGenerators.emplace_back(gameBox, randomSeeds[game]);
+        spawn(game);
+    }
+}
+
+int GameBatch::countAlive() const {
+    int count = 0;
+    for (int game = 0; game < nGames; ++game) count += alive[game];
+    return count;
+}
+
+bool GameBatch::fits(int game, int shape, int x, int y, int z) const {
+    return piece_shapes::shapeFits(shapeMasks[shape], Pos3d { x, y, z }, gameBox.dims, &layers[game], nGames);
+}
+
+int GameBatch::dropDistance(int game, int maxDistance) const {
+    const int shape = activeShape[game], x = activeX[game], y = activeY[game];
+    int distance = 0;
+    while (distance < maxDistance && fits(game, shape, x, y, activeZ[game] - distance - 1)) distance++;
+    return distance;
+}
+
+void GameBatch::spawn(int game) {
+    const Piece piece = pieceGenerators[game].nextPiece();
+    const Pos3d center = piece.getCenter();
+    activeShape[game] = piece.getShape();
+    activeX[game] = center.x;
+    activeY[game] = center.y;
+    activeZ[game] = center.z;
+    activePieceId[game] = piece.getBlocks()[0].pieceId;
+
+    if (!fits(game, activeShape[game], center.x, center.y, center.z)) alive[game] = 0;
+}
+
+void GameBatch::applyAction(int game, Action action) {
+    using piece_shapes::TABLE;
+    int shape = activeShape[game];
+    int x = activeX[game], y = activeY[game];
+
+    switch (action) {
+    case Action::NONE:
+        return;
+    case Action::MOVE_X_POS: x++; break;
+    case Action::MOVE_X_NEG: x--; break;
+    case Action::MOVE_Y_POS: y++; break;
+    case Action::MOVE_Y_NEG: y--; break;
+    case Action::DROP: {
+        const int height = dropDistance(game, activeZ[game]);
+        activeZ[game] -= height;
+        score[game] += game_config::DROP_SCORE_MULTIPLIER * height;
+        landed[game] = 1;
+        return;
+    }
+    default: {
+        const int rotation = static_cast<int>(action) - static_cast<int>(Action::ROTATE_X_CW);
+        assert( rotation >= 0 && rotation < piece_shapes::N_ROTATIONS );
+        shape = TABLE.orientations[shape].next[rotation];
+
+        const Pos3d c = gameBox.translateToBounds(shape, Pos3d { x, y, activeZ[game] });
+        if (fits(game, shape, c.x, c.y, c.z)) {
+            activeShape[game] = shape;
+            activeX[game] = c.x;
+            activeY[game] = c.y;
+            activeZ[game] = c.z;
+        }
+        return;
+    }
+    }
+
+    if (fits(game, shape, x, y, activeZ[game])) {
+        activeX[game] = x;
+        activeY[game] = y;
+    }
+}
+
+void GameBatch::applyActions(const std::vector<Action> &actions) {
+    assert( static_cast<int>(actions.size()) == nGames );
+
+    for (int game = 0; game < nGames; ++game) {
+        if (alive[game]) applyAction(game, actions[game]);
+    }
+    lockAndClear();
+}
+
+void GameBatch::tick(int dtMs) {
+    if (dtMs <= 0) return;
+    const int INTERVAL = game_config::DROP_INTERVAL_MS;
+
+    // timers, same as ConcreteGame::advanceTo: the clock stops when the
+    // game ends and saturates at INT_MAX
+    for (int game = 0; game < nGames; ++game) {
+        if (!alive[game]) continue;
+        const int dt = std::min(dtMs, std::numeric_limits<int>::max() - timeMs[game]);
+        timeMs[game] += dt;
+        const int rest = dt - timeToNextDownMs[game];
+        if (rest < 0) {
+            timeToNextDownMs[game] -= dt;
+            continue;
+        }
+        timeToNextDownMs[game] = INTERVAL - rest % INTERVAL;
+        applyGravity(game, 1 + rest / INTERVAL);
+    }
+}
+
+void GameBatch::applyGravity(int game, int nSteps) {
+    // same as ConcreteGame::applyGravity: the piece falls as far as it can
+    // at once and a piece that cannot move down lands and costs a step
+    while (nSteps > 0 && alive[game]) {
+        const int fall = dropDistance(game, nSteps);
+        activeZ[game] -= fall;
+        nSteps -= fall;
+        if (nSteps > 0) {
+            cement(game);
+            uint32_t full = 0;
+            for (int z = 0; z < gameBox.dims.z; ++z)
+                full |= uint32_t(layers[z*nGames + game] == fullLayer) << z;
+            clearAndSpawn(game, full);
+            nSteps--;
+        }
+    }
+}
+
+void GameBatch::step(const std::vector<Action> &actions, int dtMs) {
+    applyActions(actions);
+    tick(dtMs);
+}
+
+void GameBatch::lockAndClear() {
+    bool anyLanded = false;
+    for (int game = 0; game < nGames; ++game) {
+        if (!landed[game]) continue;
+        anyLanded = true;
+        cement(game);
+    }
+    if (!anyLanded) return;
+
+    // full layers of all games, contiguous and branch-free
+    std::fill(fullLayers.begin(), fullLayers.end(), 0);
+    for (int z = 0; z < gameBox.dims.z; ++z) {
+        const LayerMask *layer = &layers[z*nGames];
+        for (int game = 0; game < nGames; ++game) {
+            fullLayers[game] |= uint32_t(layer[game] == fullLayer) << z;
+        }
+    }
+
+    for (int game = 0; game < nGames; ++game) {
+        if (!landed[game]) continue;
+        landed[game] = 0;
+        clearAndSpawn(game, fullLayers[game]);
+    }
+}
+
+void GameBatch::cement(int game) {
+    const piece_shapes::ShapeMask &mask = shapeMasks[activeShape[game]];
+    const int x0 = activeX[game] + mask.min.x, y0 = activeY[game] + mask.min.y;
+    const int z0 = activeZ[game] + mask.min.z;
+    const int nLayers = mask.max.z - mask.min.z + 1;
+    for (int i = 0; i < nLayers; ++i) {
+        const LayerMask bits = mask.layers[i] << (y0*gameBox.dims.x + x0);
+        layers[(z0 + i)*nGames + game] |= bits;
+        for (LayerMask rest = bits; rest != 0; rest &= rest - 1) {
+            const int cell = (z0 + i)*layerSize + __builtin_ctzll(rest);
+            pieceIds[cell*nGames + game] = activePieceId[game];
+        }
+    }
+    nDroppedPieces[game]++;
+}
+
+void GameBatch::clearAndSpawn(int game, uint32_t full) {
+    if (full != 0) removeFullLayers(game, full);
+    // (2^nRemoved - 1)*C, see ConcreteGame::moveDown
+    score[game] += ((1 << __builtin_popcount(full)) - 1) * game_config::REMOVAL_SCORE_MULTIPLIER;
+    spawn(game);
+}
+
+void GameBatch::removeFullLayers(int game, uint32_t full) {
+    // same compaction as CementedBlockArray::removeFullLayers, including
+    // the piece ids left above the remaining layers
+    int dst = 0;
+    for (int z = 0; z < gameBox.dims.z; ++z) {
+        if (full & (uint32_t(1) << z)) continue;
+        if (dst != z) {
+            layers[dst*nGames + game] = layers[z*nGames + game];
+            for (int cell = 0; cell < layerSize; ++cell) {
+                pieceIds[(dst*layerSize + cell)*nGames + game] =
+                    pieceIds[(z*layerSize + cell)*nGames + game];
+            }
+        }
+        dst++;
+    }
+    for (int z = dst; z < gameBox.dims.z; ++z) layers[z*nGames + game] = 0;
+}
+
+void GameBatch::snapshot(int game, GameState &state) const {
+    const Pos3d &dims = gameBox.dims;
+    state.dimensions = dims;
+    for (int z = 0; z < dims.z; ++z) state.layers[z] = layers[z*nGames + game];
+    for (int cell = 0; cell < dims.z*layerSize; ++cell)
+        state.pieceIds[cell] = pieceIds[cell*nGames + game];
+
+    pieceGenerators[game].saveTo(state);
+
+    state.activeShape = activeShape[game];
+    state.activeCenter = Pos3d { activeX[game], activeY[game], activeZ[game] };
+    state.activePieceId = activePieceId[game];
+
+    state.score = score[game];
+    state.alive = alive[game] != 0;
+    state.timeMs = timeMs[game];
+    state.timeToNextDownMs = timeToNextDownMs[game];
+    state.nDroppedPieces = nDroppedPieces[game];
+}
+
+void GameBatch::restore(int game, const GameState &state) {
+    const Pos3d &dims = gameBox.dims;
+    const Pos3d d = state.dimensions;
+    if (d.x != dims.x || d.y != dims.y || d.z != dims.z) abort();
+
+    for (int z = 0; z < dims.z; ++z) layers[z*nGames + game] = state.layers[z];
+    for (int cell = 0; cell < dims.z*layerSize; ++cell)
+        pieceIds[cell*nGames + game] = state.pieceIds[cell];
+
+    pieceGenerators[game].restoreFrom(state);
+
+    activeShape[game] = state.activeShape;
+    activeX[game] = state.activeCenter.x;
+    activeY[game] = state.activeCenter.y;
+    activeZ[game] = state.activeCenter.z;
+    activePieceId[game] = state.activePieceId;
+
+    score[game] = state.score;
+    alive[game] = state.alive ? 1 : 0;
+    timeMs[game] = state.timeMs;
+    timeToNextDownMs[game] = state.timeToNextDownMs;
+    nDroppedPieces[game] = state.nDroppedPieces;
+    landed[game] = 0;
+}
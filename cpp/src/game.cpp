@@ -1,25 +1,51 @@
 #include "game.hpp"
+#include "game-config.hpp"
+#include "zobrist.hpp"
 #include <cmath>
+#include <algorithm>
+#include <limits>
+#include <assert.h>
+
+namespace {
+    // the game time saturates instead of overflowing
+    int addTime(int timeMs, int dtMs) {
+        return dtMs > std::numeric_limits<int>::max() - timeMs
+            ? std::numeric_limits<int>::max()
+            : timeMs + dtMs;
+    }
+
+    // unsupported dimensions would overflow the layer masks and GameState
+    Pos3d checkedDimensions(Pos3d dims) {
+        if (!GameState::isSupported(dims)) abort();
+        return dims;
+    }
+}
 
 std::unique_ptr<Game> buildGame(unsigned int randomSeed) {
-    return std::unique_ptr<Game>(new ConcreteGame(randomSeed));
+    return buildGame(randomSeed, game_config::DIMENSIONS);
 }
 
-namespace game_config {
-    static const Pos3d DIMENSIONS { 5, 4, 14 };
-    static const int DROP_SCORE_MULTIPLIER = 1;
-    static const int REMOVAL_SCORE_MULTIPLIER = 20;
-    static const int DROP_INTERVAL_MS = 1000;
+std::unique_ptr<Game> buildGame(unsigned int randomSeed, Pos3d dims) {
+    return std::unique_ptr<Game>(new ConcreteGame(randomSeed, dims));
 }
 
 ConcreteGame::ConcreteGame(unsigned int randomSeed)
 :
-    gameBox(game_config::DIMENSIONS),
+    ConcreteGame(randomSeed, game_config::DIMENSIONS)
+{}
+
+ConcreteGame::ConcreteGame(unsigned int randomSeed, Pos3d dims)
+:
+    gameBox(checkedDimensions(dims)),
     blockArray(gameBox),
     pieceGenerator(gameBox, randomSeed),
     activePiece(pieceGenerator.nextPiece()),
+    activeVersion(0),
     score(0),
-    alive(true),
+    // the first piece may not fit on boards narrower than the longest
+    // pieces, same as a new piece in moveDown
+    alive(blockArray.pieceFits(activePiece)),
+    timeMs(0),
     timeToNextDownMs(game_config::DROP_INTERVAL_MS),
     nDroppedPieces(0)
 {}
@@ -28,7 +54,8 @@ std::vector<Block> ConcreteGame::getActiveBlocks() const {
     if (isOver()) {
         return {};
     }
-    return activePiece.getBlocks();
+    const BlockList blocks = activePiece.getBlocks();
+    return std::vector<Block>(blocks.begin(), blocks.end());
 }
 
 std::vector<Block> ConcreteGame::getCementedBlocks() const {
@@ -42,6 +69,20 @@ std::vector<Block> ConcreteGame::getAllBlocks() const {
     return blocks;
 }
 
+void ConcreteGame::forEachActiveBlock(const BlockCallback& callback) const {
+    if (isOver()) return;
+    for (const Block &b : activePiece.getBlocks()) callback(b);
+}
+
+void ConcreteGame::forEachCementedBlock(const BlockCallback& callback) const {
+    blockArray.forEachNonEmptyBlock(callback);
+}
+
+void ConcreteGame::forEachBlock(const BlockCallback& callback) const {
+    forEachCementedBlock(callback);
+    forEachActiveBlock(callback);
+}
+
 bool ConcreteGame::isOver() const {
     return !alive;
 }
@@ -54,18 +95,96 @@ Pos3d ConcreteGame::getDimensions() const {
     return gameBox.dims;
 }
 
+unsigned int ConcreteGame::getActiveVersion() const {
+    return activeVersion;
+}
+
+unsigned int ConcreteGame::getCementedVersion() const {
+    return blockArray.getJournal().getVersion();
+}
+
+bool ConcreteGame::getCementedChangesSince(unsigned int version,
+    std::vector<CementedChange> &changes) const
+{
+    return blockArray.getJournal().getChangesSince(version, changes);
+}
+
+void ConcreteGame::snapshot(GameState &state) const {
+    assert( activePiece.getShape() != Piece::NO_SHAPE );
+
+    blockArray.saveTo(state);
+    pieceGenerator.saveTo(state);
+
+    state.activeShape = activePiece.getShape();
+    state.activeCenter = activePiece.getCenter();
+    state.activePieceId = activePiece.getBlocks()[0].pieceId;
+
+    state.score = score;
+    state.alive = alive;
+    state.timeMs = timeMs;
+    state.timeToNextDownMs = timeToNextDownMs;
+    state.nDroppedPieces = nDroppedPieces;
+}
+
+uint64_t ConcreteGame::getZobristKey() const {
+    return blockArray.getZobristKey() ^
+        zobrist::pieceKey(activePiece.getShape(), activePiece.getCenter());
+}
+
+void ConcreteGame::restore(const GameState &state) {
+    blockArray.restoreFrom(state);
+    pieceGenerator.restoreFrom(state);
+
+    activePiece = Piece(state.activeCenter, state.activeShape, state.activePieceId);
+    activeVersion++;
+
+    score = state.score;
+    alive = state.alive;
+    timeMs = state.timeMs;
+    timeToNextDownMs = state.timeToNextDownMs;
+    nDroppedPieces = state.nDroppedPieces;
+}
+
 // timed events
 bool ConcreteGame::tick(int dtMs) {
+    if (dtMs <= 0) return false;
+    return advanceTo(addTime(timeMs, dtMs));
+}
 
-    if (isOver()) return false;
+int ConcreteGame::getTimeMs() const {
+    return timeMs;
+}
+
+bool ConcreteGame::advanceTo(int newTimeMs) {
+
+    // the clock stops when the game ends
+    if (newTimeMs <= timeMs || isOver()) return false;
 
-    timeToNextDownMs -= dtMs;
-    if (timeToNextDownMs <= 0) {
-        moveDown();
-        timeToNextDownMs = game_config::DROP_INTERVAL_MS;
-        return true;
+    int dtMs = newTimeMs - timeMs;
+    timeMs = newTimeMs;
+    if (timeToNextDownMs > dtMs) {
+        timeToNextDownMs -= dtMs;
+        return false;
     }
-    return false;
+
+    // the first interval ends after timeToNextDownMs, the remainder of the
+    // last unfinished one is carried over
+    dtMs -= timeToNextDownMs;
+    const int nSteps = 1 + dtMs / game_config::DROP_INTERVAL_MS;
+    timeToNextDownMs = game_config::DROP_INTERVAL_MS - dtMs % game_config::DROP_INTERVAL_MS;
+
+    applyGravity(nSteps);
+    return true;
+}
+
+int ConcreteGame::msUntilNextEvent() const {
+    if (isOver()) return -1;
+    return timeToNextDownMs;
+}
+
+bool ConcreteGame::advanceToNextEvent() {
+    if (isOver()) return false;
+    return advanceTo(addTime(timeMs, timeToNextDownMs));
 }
 
 // controls
@@ -86,9 +205,13 @@ bool ConcreteGame::rotate(Axis axis, RotationDirection dir) {
 
 void ConcreteGame::drop() {
     if (isOver()) return;
-    int height = 0;
-    while (moveDown()) height++;
+    const int height = blockArray.dropDistance(activePiece);
+    activePiece = activePiece.translated(Pos3d {0,0,-height});
+    activeVersion++;
     score += game_config::DROP_SCORE_MULTIPLIER * height;
+
+    // cannot move down anymore: cement and spawn the next piece
+    moveDown();
 }
 
 // private helpers
@@ -102,20 +225,15 @@ bool ConcreteGame::moveDown() {
         blockArray.cementPiece(activePiece);
         nDroppedPieces++;
 
-        // remove empty layers
-        int nRemoved = 0;
-        for (int z = gameBox.dims.z - 1; z >= 0; --z) {
-            if (blockArray.isLayerFull(z)) {
-                blockArray.removeLayer(z);
-                nRemoved++;
-            }
-        }
+        // remove full layers
+        const int nRemoved = blockArray.removeFullLayers();
         // (2^nRemoved - 1)*C
         // 0 -> 0, 1 -> C, 2 -> 3C, 3 -> 7C, ...
         score += ((1 << nRemoved) - 1) * game_config::REMOVAL_SCORE_MULTIPLIER;
 
         // new piece, check if fits
         activePiece = pieceGenerator.nextPiece();
+        activeVersion++;
         if (!blockArray.pieceFits(activePiece)) {
             alive = false;
         }
@@ -124,10 +242,27 @@ bool ConcreteGame::moveDown() {
     return true;
 }
 
+void ConcreteGame::applyGravity(int nSteps) {
+    while (nSteps > 0 && !isOver()) {
+        const int fall = std::min(blockArray.dropDistance(activePiece), nSteps);
+        if (fall > 0) {
+            activePiece = activePiece.translated(Pos3d {0,0,-fall});
+            activeVersion++;
+            nSteps -= fall;
+        }
+        if (nSteps > 0) {
+            // landed, the next step cements the piece
+            moveDown();
+            nSteps--;
+        }
+    }
+}
+
 bool ConcreteGame::setActivePieceIfFits(const Piece& candidate) {
     if (!blockArray.pieceFits(candidate)) {
         return false;
     }
     activePiece = candidate;
+    activeVersion++;
     return true;
 }
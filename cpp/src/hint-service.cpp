@@ -0,0 +1,154 @@
+#include "hint-service.hpp"
+#include <algorithm>
+#include <assert.h>
+
+namespace {
+    // beam width and lookahead of each search, from the greedy choice that
+    // gives a first hint almost at once to the strongest
+    const struct {
+        int beamWidth, lookahead;
+    } STAGES[] = { { 1, 0 }, { 8, 1 }, { 16, 2 } };
+}
+
+HintService::HintService(Pos3d dims, WorkStealingPool &pool)
+:
+    incoming(new GameState()),
+    pending(new GameState()),
+    working(new GameState()),
+    stopping(false),
+    hasPending(false),
+    pendingBudgetMs(0),
+    requestId(0),
+    hintRequestId(0),
+    hasHint(false),
+    requestedActiveVersion(0),
+    requestedCementedVersion(0)
+{
+    for (const auto &s : STAGES) {
+        stages.emplace_back(new Autoplayer(dims, pool, s.beamWidth, s.lookahead));
+    }
+    worker = std::thread(&HintService::run, this);
+}
+
+HintService::~HintService() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        requestId++;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+}
+
+void HintService::request(const Game &game, int budgetMs) {
+    assert( budgetMs > 0 );
+    const auto now = Clock::now();
+    requestedActiveVersion = game.getActiveVersion();
+    requestedCementedVersion = game.getCementedVersion();
+    // the copy is made outside the lock, into the buffer the worker
+    // does not have
+    game.snapshot(*incoming);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        incoming.swap(pending);
+        hasPending = true;
+        pendingBudgetMs = budgetMs;
+        pendingTime = now;
+        requestId++;
+        hasHint = false;
+    }
+    wakeWorker.notify_one();
+}
+
+bool HintService::getHint(const Game &game, Hint &result) {
+    if (game.getActiveVersion() != requestedActiveVersion ||
+        game.getCementedVersion() != requestedCementedVersion)
+    {
+        cancel();
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!hasHint || hintRequestId != requestId) return false;
+    result = hint;
+    return true;
+}
+
+bool HintService::waitForHint(Hint &result, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const unsigned long id = requestId;
+    hintChanged.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]() {
+        return requestId != id || (hasHint && hint.final);
+    });
+    if (!hasHint || hintRequestId != requestId) return false;
+    result = hint;
+    return true;
+}
+
+void HintService::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (requestId == 0) return;
+        requestId++;
+        hasPending = false;
+        hasHint = false;
+    }
+    hintChanged.notify_all();
+}
+
+void HintService::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wakeWorker.wait(lock, [this]() { return stopping || hasPending; });
+        if (stopping) return;
+        pending.swap(working);
+        hasPending = false;
+        const unsigned long id = requestId;
+        const int budgetMs = pendingBudgetMs;
+        const auto start = pendingTime;
+
+        lock.unlock();
+        analyse(id, *working, budgetMs, start);
+        lock.lock();
+    }
+}
+
+void HintService::analyse(unsigned long id, const GameState &state, int budgetMs, Clock::time_point start) {
+    const auto deadline = start + std::chrono::milliseconds(budgetMs);
+    int bestDepth = 0;
+    for (std::size_t i = 0; i < stages.size(); ++i) {
+        if (requestId.load() != id) return;
+        const int remainingMs = static_cast<int>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count());
+        // the first search always runs so that there is some hint
+        if (i > 0 && remainingMs <= 0) break;
+
+        Autoplayer &autoplayer = *stages[i];
+        stageInputs.clear();
+        const bool found = autoplayer.chooseInputs(state, std::max(remainingMs, 1), stageInputs);
+        const int depth = autoplayer.getLastDepth();
+        const bool last = !found || i + 1 == stages.size();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (requestId != id) return;
+        // a search cut short by the budget may not reach deeper than the
+        // previous one
+        if (!found || depth > bestDepth) {
+            hint.found = found;
+            hint.inputs = stageInputs;
+            hint.depth = depth;
+            hint.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            bestDepth = depth;
+        }
+        hint.final = last;
+        hintRequestId = id;
+        hasHint = true;
+        hintChanged.notify_all();
+        if (last) return;
+    }
+
+    // out of time before the last search
+    std::lock_guard<std::mutex> lock(mutex);
+    if (requestId != id) return;
+    hint.final = true;
+    hintChanged.notify_all();
+}
@@ -0,0 +1,309 @@
+#include "mcts-search.hpp"
+#include "game-config.hpp"
+#include "piece-generator.hpp"
+#include "piece-shapes.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <assert.h>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    // rewards are summed as fixed point numbers so that plain atomics work
+    const double REWARD_SCALE = 1e6;
+    // visits added to a path while its playout is in progress
+    const int VIRTUAL_LOSS = 3;
+    const double EXPLORATION = 0.7;
+
+    double meanReward(int visits, long long rewardSum) {
+        return visits == 0 ? 0.0 : rewardSum / REWARD_SCALE / visits;
+    }
+}
+
+MctsSearch::Context::Context(Pos3d dims, uint64_t seed)
+:
+    generator(dims),
+    game(static_cast<unsigned int>(seed), dims),
+    state(new GameState()),
+    board(dims.z),
+    random(seed)
+{}
+
+MctsSearch::MctsSearch(Pos3d dims, WorkStealingPool &pool, int rolloutPieces, double layerBonus)
+:
+    gameBox(dims),
+    pool(pool),
+    rolloutPieces(rolloutPieces),
+    layerBonus(layerBonus),
+    rootContext(new Context(dims, 0)),
+    root(nullptr),
+    state(new GameState())
+{
+    assert( rolloutPieces > 0 );
+    for (int i = 0; i <= pool.getThreadCount(); ++i) {
+        contexts.emplace_back(new Context(dims, i + 1));
+    }
+}
+
+MctsSearch::Context &MctsSearch::localContext() {
+    const int worker = pool.getWorkerIndex();
+    assert( worker >= 0 || std::this_thread::get_id() == searchThread );
+    return *contexts[worker < 0 ? pool.getThreadCount() : worker];
+}
+
+std::size_t MctsSearch::getTreeBytes() const {
+    std::size_t bytes = rootContext->arena.getUsedBytes();
+    for (const auto &c : contexts) bytes += c->arena.getUsedBytes();
+    return bytes;
+}
+
+void MctsSearch::expand(Context &context, DecisionNode &node) {
+    const int dimZ = gameBox.dims.z;
+    GameState &s = *context.state;
+    s.dimensions = gameBox.dims;
+    std::copy(node.board, node.board + dimZ, s.layers);
+    s.activeShape = node.shape;
+    s.activeCenter = node.center;
+    s.alive = true;
+
+    const std::vector<Placement> &placements = context.generator.generate(s);
+    const int n = static_cast<int>(placements.size());
+    ChanceNode *children = context.arena.createArray<ChanceNode>(n);
+    for (int i = 0; i < n; ++i) {
+        std::copy(node.board, node.board + dimZ, context.board.begin());
+        children[i].nRemoved = context.generator.place(placements[i], context.board.data());
+        children[i].placement = placements[i];
+    }
+    node.nChildren = n;
+    node.children = children;
+}
+
+MctsSearch::DecisionNode *MctsSearch::outcome(Context &context, const DecisionNode &parent, ChanceNode &node) {
+    const int shape = PieceGenerator::randomShape(context.random);
+    DecisionNode *created = nullptr;
+    DecisionNode *head = node.outcomes.load(std::memory_order_acquire);
+    for (;;) {
+        for (DecisionNode *d = head; d != nullptr; d = d->next) {
+            if (d->shape == shape) return d;
+        }
+        if (created == nullptr) {
+            // same spawn pose as PieceGenerator::nextPiece
+            const Pos3d &dims = gameBox.dims;
+            uint64_t *board = static_cast<uint64_t*>(
+                context.arena.allocate(sizeof(uint64_t)*dims.z, alignof(uint64_t)));
+            std::copy(parent.board, parent.board + dims.z, board);
+            context.generator.place(node.placement, board);
+            created = context.arena.create<DecisionNode>();
+            created->board = board;
+            created->shape = shape;
+            created->center = gameBox.translateToBounds(shape, Pos3d { dims.x/2, dims.y/2, dims.z + 5 });
+        }
+        created->next = head;
+        // on failure, head is reloaded and searched again since another
+        // thread may have added the same piece
+        if (node.outcomes.compare_exchange_weak(head, created,
+            std::memory_order_acq_rel, std::memory_order_acquire)) return created;
+    }
+}
+
+MctsSearch::ChanceNode *MctsSearch::select(DecisionNode &node) const {
+    const int parentVisits = node.stats.visits.load(std::memory_order_relaxed);
+    const double logParent = std::log(static_cast<double>(std::max(parentVisits, 1)));
+    ChanceNode *best = nullptr;
+    double bestScore = -std::numeric_limits<double>::infinity();
+    for (int i = 0; i < node.nChildren; ++i) {
+        ChanceNode &child = node.children[i];
+        const int visits = child.stats.visits.load(std::memory_order_relaxed);
+        // unvisited children first, in order
+        if (visits == 0) return &child;
+        const double score = meanReward(visits, child.stats.rewardSum.load(std::memory_order_relaxed)) +
+            EXPLORATION * std::sqrt(logParent / visits);
+        if (score > bestScore) {
+            bestScore = score;
+            best = &child;
+        }
+    }
+    return best;
+}
+
+double MctsSearch::rollout(Context &context, const DecisionNode &node) {
+    const Pos3d &dims = gameBox.dims;
+    const int layerSize = dims.x*dims.y;
+    GameState &s = *context.state;
+    s.dimensions = dims;
+    std::copy(node.board, node.board + dims.z, s.layers);
+    std::fill(s.pieceIds, s.pieceIds + dims.x*dims.y*dims.z, 0);
+    s.activeShape = node.shape;
+    s.activeCenter = node.center;
+    s.activePieceId = 0;
+    s.score = 0;
+    s.alive = true;
+    s.timeMs = 0;
+    s.timeToNextDownMs = game_config::DROP_INTERVAL_MS;
+    s.nDroppedPieces = 0;
+    // the pieces after the active one are drawn by the game itself
+    for (uint32_t &word : s.randomState) word = context.random.next();
+    s.nextPieceId = 1;
+    context.game.restore(s);
+
+    int nBlocksBefore = 0;
+    for (int z = 0; z < dims.z; ++z) nBlocksBefore += __builtin_popcountll(node.board[z]);
+
+    // random rotations and moves, then drop
+    Game &game = context.game;
+    int nPlaced = 0;
+    for (int i = 0; i < rolloutPieces; ++i) {
+        const int nRotations = context.random.nextBelow(3);
+        for (int r = 0; r < nRotations; ++r) {
+            const Rotation rot = piece_shapes::indexToRotation(context.random.nextBelow(piece_shapes::N_ROTATIONS));
+            game.rotate(rot.axis, rot.direction);
+        }
+        const int dx = static_cast<int>(context.random.nextBelow(dims.x)) - dims.x/2;
+        const int dy = static_cast<int>(context.random.nextBelow(dims.y)) - dims.y/2;
+        for (int j = 0; j < std::abs(dx); ++j) game.moveXY(dx > 0 ? 1 : -1, 0);
+        for (int j = 0; j < std::abs(dy); ++j) game.moveXY(0, dy > 0 ? 1 : -1);
+        game.drop();
+        if (game.isOver()) break;
+        nPlaced++;
+    }
+
+    context.game.snapshot(s);
+    int nBlocksAfter = 0;
+    for (int z = 0; z < dims.z; ++z) nBlocksAfter += __builtin_popcountll(s.layers[z]);
+    const int nDropped = nPlaced + (nPlaced < rolloutPieces ? 1 : 0);
+    const int nRemoved = std::max(0,
+        (nBlocksBefore + piece_shapes::N_BLOCKS*nDropped - nBlocksAfter) / layerSize);
+
+    return static_cast<double>(nPlaced) / rolloutPieces + layerBonus*nRemoved;
+}
+
+void MctsSearch::playout(Context &context) {
+    context.path.clear();
+    context.decisions.clear();
+
+    DecisionNode *node = root;
+    node->stats.visits += VIRTUAL_LOSS;
+    context.decisions.push_back(node);
+    bool over = false;
+    for (;;) {
+        int nodeState = node->state.load(std::memory_order_acquire);
+        if (nodeState == DecisionNode::UNEXPANDED &&
+            node->state.compare_exchange_strong(nodeState, DecisionNode::EXPANDING,
+                std::memory_order_acq_rel))
+        {
+            expand(context, *node);
+            node->state.store(DecisionNode::EXPANDED, std::memory_order_release);
+            over = node->nChildren == 0;
+            break;
+        }
+        // another playout is expanding the node, roll out from it
+        if (nodeState != DecisionNode::EXPANDED) break;
+        if (node->nChildren == 0) {
+            over = true;
+            break;
+        }
+
+        ChanceNode *chance = select(*node);
+        chance->stats.visits += VIRTUAL_LOSS;
+        context.path.push_back(chance);
+        node = outcome(context, *node, *chance);
+        node->stats.visits += VIRTUAL_LOSS;
+        context.decisions.push_back(node);
+    }
+
+    int nRemoved = 0;
+    for (const ChanceNode *chance : context.path) nRemoved += chance->nRemoved;
+    const double reward = layerBonus*nRemoved + (over ? 0.0 : rollout(context, *node));
+
+    // replace the virtual loss with the reward
+    const long long scaled = std::llround(reward * REWARD_SCALE);
+    for (ChanceNode *chance : context.path) {
+        chance->stats.rewardSum += scaled;
+        chance->stats.visits -= VIRTUAL_LOSS - 1;
+    }
+    for (DecisionNode *decision : context.decisions) {
+        decision->stats.rewardSum += scaled;
+        decision->stats.visits -= VIRTUAL_LOSS - 1;
+    }
+}
+
+MctsSearch::Result MctsSearch::search(const GameState &current, long nPlayouts, int budgetMs) {
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::milliseconds(budgetMs);
+    const bool hasDeadline = budgetMs > 0;
+
+    searchThread = std::this_thread::get_id();
+    rootContext->arena.reset();
+    for (auto &c : contexts) c->arena.reset();
+
+    Result result;
+    result.found = false;
+    result.value = 0;
+    result.visits = 0;
+    result.nPlayouts = 0;
+
+    root = rootContext->arena.create<DecisionNode>();
+    uint64_t *board = static_cast<uint64_t*>(
+        rootContext->arena.allocate(sizeof(uint64_t)*gameBox.dims.z, alignof(uint64_t)));
+    std::copy(current.layers, current.layers + gameBox.dims.z, board);
+    root->board = board;
+    root->shape = current.activeShape;
+    root->center = current.activeCenter;
+    if (current.alive) expand(*rootContext, *root);
+    root->state.store(DecisionNode::EXPANDED, std::memory_order_release);
+
+    if (root->nChildren > 0) {
+        std::atomic<long> nStarted(0), nDone(0);
+        {
+            TaskGroup tasks(pool);
+            for (int t = 0; t < pool.getThreadCount(); ++t) {
+                tasks.run([&]() {
+                    Context &context = localContext();
+                    while (nStarted++ < nPlayouts) {
+                        if (hasDeadline && Clock::now() >= deadline) break;
+                        playout(context);
+                        nDone++;
+                    }
+                });
+            }
+            tasks.wait();
+        }
+        result.nPlayouts = nDone;
+
+        // the most visited placement, ties by the mean reward
+        const ChanceNode *best = nullptr;
+        for (int i = 0; i < root->nChildren; ++i) {
+            const ChanceNode &child = root->children[i];
+            if (best == nullptr || child.stats.visits > best->stats.visits ||
+                (child.stats.visits == best->stats.visits && child.stats.rewardSum > best->stats.rewardSum))
+            {
+                best = &child;
+            }
+        }
+        result.found = true;
+        result.placement = best->placement;
+        result.visits = best->stats.visits;
+        result.value = meanReward(best->stats.visits, best->stats.rewardSum);
+    }
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.playoutsPerSecond = result.nPlayouts / std::max(result.seconds, 1e-9);
+    return result;
+}
+
+void MctsSearch::getInputs(const Placement &placement, std::vector<PlacementInput> &result) {
+    rootContext->generator.getInputs(placement, result);
+}
+
+bool MctsSearch::play(Game &game, long nPlayouts, int budgetMs) {
+    if (game.isOver()) return false;
+    game.snapshot(*state);
+    const Result result = search(*state, nPlayouts, budgetMs);
+    if (!result.found) return false;
+    inputs.clear();
+    getInputs(result.placement, inputs);
+    for (PlacementInput input : inputs) placements::applyInput(game, input);
+    return true;
+}
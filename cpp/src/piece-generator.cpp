@@ -1,90 +1,42 @@
 #include "piece-generator.hpp"
-
-namespace piece_generator {
-    Piece prototypeToPiece( std::vector<Pos3d> pos, int pieceId ) {
-        std::vector<Block> blocks;
-        for (Pos3d p : pos) blocks.push_back(Block {p, pieceId});
-        return Piece(blocks);
-    }
-}
+#include "piece-shapes.hpp"
 
 PieceGenerator::PieceGenerator(const GameBox& gameBox_, int randomSeed)
 :
-    random(randomSeed),
+    random(static_cast<unsigned int>(randomSeed)),
     gameBox(gameBox_),
-    pieceId(0),
-    prototypes {
-        {
-            Pos3d { -1,0,0 }, //  ##
-            Pos3d { 0,0,0 },  // ##
-            Pos3d { 0,1,0 },
-            Pos3d { 1,1,0 }
-        },
-        {
-            Pos3d { -1,0,0 }, // ####
-            Pos3d { 0,0,0 },
-            Pos3d { 1,0,0 },
-            Pos3d { 2,0,0 }
-        },
-        {
-            Pos3d { -1,0,0 }, // ###
-            Pos3d { 0,0,0 },  //   #
-            Pos3d { 1,0,0 },
-            Pos3d { 1,1,0 }
-        },
-        {
-            Pos3d { -1,0,0 }, // ###
-            Pos3d { 0,0,0 },  //  #
-            Pos3d { 1,0,0 },
-            Pos3d { 0,1,0 }
-        },
-        {
-            Pos3d { 0,0,0 }, // ##
-            Pos3d { 0,1,0 },  // ##
-            Pos3d { 1,0,0 },
-            Pos3d { 1,1,0 }
-        },
-        {
-            Pos3d { -1,0,0 }, // ##
-            Pos3d { 0,0,0 },  //  o
-            Pos3d { 0,1,1 },
-            Pos3d { 0,1,0 }
-        },
-        {
-            Pos3d { -1,0,0 }, // o#
-            Pos3d { 0,0,0 },  //  #
-            Pos3d { -1,0,1 },
-            Pos3d { 0,1,0 }
-        },
-        {
-            Pos3d { 0,0,0 }, // o#
-            Pos3d { 1,0,0 }, // #
-            Pos3d { 0,1,0 },
-            Pos3d { 0,0,1 }
-        },
-    }
+    pieceId(0)
 {}
 
+int PieceGenerator::randomShape(Xoshiro128 &random) {
+    using piece_shapes::TABLE;
+
+    const int proto = random.nextBelow(piece_shapes::N_PROTOTYPES);
+
+    // random orientation, picked uniformly from the distinct ones
+    return TABLE.first[proto] + random.nextBelow(TABLE.count[proto]);
+}
+
 Piece PieceGenerator::nextPiece() {
-    std::uniform_int_distribution<> dist(0, prototypes.size()-1);
-    return randomTransformation(
-        piece_generator::prototypeToPiece(
-            prototypes[dist(random)],
-            pieceId++)
-                .translated(Pos3d{
-                    gameBox.dims.x/2,
-                    gameBox.dims.y/2,
-                    gameBox.dims.z + 5
-                }));
+    const int shape = randomShape(random);
+
+    return gameBox.translateToBounds(
+        Piece(
+            Pos3d {
+                gameBox.dims.x/2,
+                gameBox.dims.y/2,
+                gameBox.dims.z + 5
+            },
+            shape,
+            pieceId++));
+}
+
+void PieceGenerator::saveTo(GameState &state) const {
+    random.getState(state.randomState);
+    state.nextPieceId = pieceId;
 }
 
-Piece PieceGenerator::randomTransformation(const Piece& original) {
-    Piece piece = original;
-    std::uniform_int_distribution<> lessThanFour(0, 4);
-    for (Axis axis : { Axis::X, Axis::Y, Axis::Z} ) {
-        for (int i = 0; i < lessThanFour(random); ++i) {
-            piece = piece.rotated(Rotation{axis, RotationDirection::CCW});
-        }
-    }
-    return gameBox.translateToBounds(piece);
+void PieceGenerator::restoreFrom(const GameState &state) {
+    random.setState(state.randomState);
+    pieceId = state.nextPieceId;
 }
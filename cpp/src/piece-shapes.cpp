@@ -0,0 +1,163 @@
+#include "piece-shapes.hpp"
+
+namespace piece_shapes {
+    namespace {
+        constexpr Pos3d PROTOTYPES[N_PROTOTYPES][N_BLOCKS] = {
+            {
+                Pos3d { -1,0,0 }, //  ##
+                Pos3d { 0,0,0 },  // ##
+                Pos3d { 0,1,0 },
+                Pos3d { 1,1,0 }
+            },
+            {
+                Pos3d { -1,0,0 }, // ####
+                Pos3d { 0,0,0 },
+                Pos3d { 1,0,0 },
+                Pos3d { 2,0,0 }
+            },
+            {
+                Pos3d { -1,0,0 }, // ###
+                Pos3d { 0,0,0 },  //   #
+                Pos3d { 1,0,0 },
+                Pos3d { 1,1,0 }
+            },
+            {
+                Pos3d { -1,0,0 }, // ###
+                Pos3d { 0,0,0 },  //  #
+                Pos3d { 1,0,0 },
+                Pos3d { 0,1,0 }
+            },
+            {
+                Pos3d { 0,0,0 }, // ##
+                Pos3d { 0,1,0 },  // ##
+                Pos3d { 1,0,0 },
+                Pos3d { 1,1,0 }
+            },
+            {
+                Pos3d { -1,0,0 }, // ##
+                Pos3d { 0,0,0 },  //  o
+                Pos3d { 0,1,1 },
+                Pos3d { 0,1,0 }
+            },
+            {
+                Pos3d { -1,0,0 }, // o#
+                Pos3d { 0,0,0 },  //  #
+                Pos3d { -1,0,1 },
+                Pos3d { 0,1,0 }
+            },
+            {
+                Pos3d { 0,0,0 }, // o#
+                Pos3d { 1,0,0 }, // #
+                Pos3d { 0,1,0 },
+                Pos3d { 0,0,1 }
+            },
+        };
+
+        constexpr bool posLess(Pos3d a, Pos3d b) {
+            if (a.z != b.z) return a.z < b.z;
+            if (a.y != b.y) return a.y < b.y;
+            return a.x < b.x;
+        }
+
+        constexpr bool posEqual(Pos3d a, Pos3d b) {
+            return a.x == b.x && a.y == b.y && a.z == b.z;
+        }
+
+        // sorts the blocks and computes the bounding box
+        constexpr Orientation normalized(Orientation o) {
+            for (int i = 1; i < N_BLOCKS; ++i) {
+                for (int j = i; j > 0 && posLess(o.blocks[j], o.blocks[j-1]); --j) {
+                    const Pos3d tmp = o.blocks[j];
+                    o.blocks[j] = o.blocks[j-1];
+                    o.blocks[j-1] = tmp;
+                }
+            }
+            o.min = o.blocks[0];
+            o.max = o.blocks[0];
+            for (const Pos3d &p : o.blocks) {
+                o.min = Pos3d {
+                    p.x < o.min.x ? p.x : o.min.x,
+                    p.y < o.min.y ? p.y : o.min.y,
+                    p.z < o.min.z ? p.z : o.min.z
+                };
+                o.max = Pos3d {
+                    p.x > o.max.x ? p.x : o.max.x,
+                    p.y > o.max.y ? p.y : o.max.y,
+                    p.z > o.max.z ? p.z : o.max.z
+                };
+            }
+            return o;
+        }
+
+        constexpr bool sameBlocks(const Orientation &a, const Orientation &b) {
+            for (int i = 0; i < N_BLOCKS; ++i) {
+                if (!posEqual(a.blocks[i], b.blocks[i])) return false;
+            }
+            return true;
+        }
+
+        constexpr Orientation rotated(const Orientation &o, Rotation rot) {
+            Orientation r = o;
+            for (Pos3d &p : r.blocks) p = pos_methods::rotate(p, rot);
+            return normalized(r);
+        }
+
+        // breadth-first search over the elementary rotations of each
+        // prototype, keeping only orientations with distinct block sets
+        constexpr ShapeTable buildTable() {
+            ShapeTable table {};
+            for (int proto = 0; proto < N_PROTOTYPES; ++proto) {
+                const int first = table.size;
+
+                Orientation initial {};
+                for (int i = 0; i < N_BLOCKS; ++i) {
+                    initial.blocks[i] = PROTOTYPES[proto][i];
+                }
+                initial.prototype = proto;
+                table.orientations[table.size++] = normalized(initial);
+
+                for (int cur = first; cur < table.size; ++cur) {
+                    for (int r = 0; r < N_ROTATIONS; ++r) {
+                        const Orientation candidate = rotated(
+                            table.orientations[cur], indexToRotation(r));
+
+                        int found = first;
+                        while (found < table.size &&
+                            !sameBlocks(table.orientations[found], candidate))
+                            found++;
+
+                        if (found == table.size) {
+                            table.orientations[table.size++] = candidate;
+                        }
+                        table.orientations[cur].next[r] = found;
+                    }
+                }
+
+                table.first[proto] = first;
+                table.count[proto] = table.size - first;
+            }
+            return table;
+        }
+    }
+
+    constexpr ShapeTable TABLE = buildTable();
+
+    std::vector<ShapeMask> buildShapeMasks(Pos3d dims) {
+        std::vector<ShapeMask> masks(TABLE.size);
+        for (int shape = 0; shape < TABLE.size; ++shape) {
+            const Orientation &orientation = TABLE.orientations[shape];
+            ShapeMask &mask = masks[shape];
+            mask.min = orientation.min;
+            mask.max = orientation.max;
+            for (uint64_t &layer : mask.layers) layer = 0;
+
+            // blocks past 64 bits only occur in orientations that do not
+            // fit the board, and shapeFits rejects those by their bounds
+            for (Pos3d p : orientation.blocks) {
+                const int bit = (p.y - mask.min.y)*dims.x + p.x - mask.min.x;
+                if (bit < 64) mask.layers[p.z - mask.min.z] |= uint64_t(1) << bit;
+            }
+        }
+        return masks;
+    }
+}
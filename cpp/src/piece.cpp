@@ -1,7 +1,7 @@
 #include "piece.hpp"
+#include "piece-shapes.hpp"
 #include <array>
 #include <algorithm>
-#include <iterator>
 #include <assert.h>
 
 namespace pos_methods {
@@ -14,43 +14,6 @@ namespace pos_methods {
         return {{ pos.x, pos.y, pos.z }};
     }
 
-    Pos3d rotate(Pos3d pos, Rotation rot) {
-
-        // 90 degeree rotation along X, Y or Z means exchanging/swapping
-        // the values of the other two axes and flipping the sign on
-        // one of these
-
-        // which two axes are swapped by this rotation (order is important)
-        Axis exAx0, exAx1;
-        switch (rot.axis) {
-        case Axis::X:
-            exAx0 = Axis::Y;
-            exAx1 = Axis::Z;
-            break;
-        case Axis::Y:
-            exAx0 = Axis::Z;
-            exAx1 = Axis::X;
-            break;
-        case Axis::Z:
-            exAx0 = Axis::X;
-            exAx1 = Axis::Y;
-            break;
-        }
-
-        // determines on which axis the sign is flipped
-        const int sign = rot.direction == RotationDirection::CCW ? 1 : -1;
-
-        // before & after
-        auto p0 = toArray(pos);
-        decltype(p0) p1 = p0;
-
-        // swap & sign flip
-        p1[static_cast<int>(exAx0)] = -sign*p0[static_cast<int>(exAx1)];
-        p1[static_cast<int>(exAx1)] = sign*p0[static_cast<int>(exAx0)];
-
-        return fromArray(p1);
-    }
-
     Pos3d setElement(const Pos3d &pos, Axis ax, int value) {
         auto a = toArray(pos);
         a[static_cast<int>(ax)] = value;
@@ -58,7 +21,12 @@ namespace pos_methods {
     }
 
     int getElement(const Pos3d &pos, Axis ax) {
-        return toArray(pos)[static_cast<int>(ax)];
+        switch (ax) {
+        case Axis::X: return pos.x;
+        case Axis::Y: return pos.y;
+        case Axis::Z:
+        default: return pos.z;
+        }
     }
 }
 
@@ -86,14 +54,33 @@ Collection map(Collection col, unop op) {
     return col;
 }
 
+const int BlockList::MAX_SIZE;
+const int Piece::NO_SHAPE;
+
+Piece::Piece(Pos3d center_, int shape_, int pieceId)
+:
+    center(center_),
+    shape(shape_)
+{
+    const auto &orientation = piece_shapes::TABLE.orientations[shape];
+    for (Pos3d pos : orientation.blocks) blocks.push_back(Block { pos, pieceId });
+}
+
 Piece Piece::translated(Pos3d delta) const {
-    return Piece {
-        pos_methods::sum(center, delta),
-        blocks
-    };
+    Piece piece = *this;
+    piece.center = pos_methods::sum(center, delta);
+    return piece;
 }
 
 Piece Piece::rotated(Rotation rot) const {
+    if (shape != NO_SHAPE) {
+        return Piece {
+            center,
+            piece_shapes::TABLE.orientations[shape].next[
+                piece_shapes::rotationIndex(rot)],
+            blocks[0].pieceId
+        };
+    }
     return Piece {
         center,
         map(blocks, [rot](Block b){ return block_methods::rotate(b, rot); })
@@ -103,16 +90,21 @@ Piece Piece::rotated(Rotation rot) const {
 int Piece::getExtent(Axis axis, int direction) const {
     assert(direction == 1 || direction == -1);
 
-    auto blocks = getBlocks();
-
-    std::vector<int> coords;
-    for (auto b : blocks) {
-        coords.push_back(pos_methods::getElement(b.pos, axis));
+    if (shape != NO_SHAPE) {
+        const auto &orientation = piece_shapes::TABLE.orientations[shape];
+        return pos_methods::getElement(
+            direction > 0 ? orientation.max : orientation.min, axis)
+            + pos_methods::getElement(center, axis);
     }
 
-    return direction > 0 ?
-        *std::max_element(coords.begin(), coords.end()) :
-        *std::min_element(coords.begin(), coords.end());
+    assert(!blocks.empty());
+
+    int extent = pos_methods::getElement(blocks[0].pos, axis);
+    for (const Block &b : blocks) {
+        const int coord = pos_methods::getElement(b.pos, axis);
+        extent = direction > 0 ? std::max(extent, coord) : std::min(extent, coord);
+    }
+    return extent + pos_methods::getElement(center, axis);
 }
 
 Piece Piece::translatedBeyond(Axis axis, int limit, int direction) const {
@@ -130,7 +122,7 @@ Piece Piece::translatedBeyond(Axis axis, int limit, int direction) const {
     return *this;
 }
 
-std::vector<Block> Piece::getBlocks() const {
+BlockList Piece::getBlocks() const {
     const Pos3d c = center;
     return map(blocks, [c](const Block &b){
         return block_methods::translate(b, c);
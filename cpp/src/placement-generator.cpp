@@ -0,0 +1,321 @@
+#include "placement-generator.hpp"
+#include "piece-shapes.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <assert.h>
+
+namespace {
+    bool testAndSet(std::vector<uint64_t> &bits, int index) {
+        uint64_t &word = bits[index / 64];
+        const uint64_t bit = uint64_t(1) << (index % 64);
+        const bool wasSet = (word & bit) != 0;
+        word |= bit;
+        return wasSet;
+    }
+
+    bool isSet(const std::vector<uint64_t> &bits, int index) {
+        return (bits[index / 64] >> (index % 64)) & 1;
+    }
+}
+
+PlacementGenerator::PlacementGenerator(Pos3d dims)
+:
+    gameBox(dims),
+    shapeMasks(piece_shapes::buildShapeMasks(dims)),
+    inBounds(piece_shapes::TABLE.size, 0),
+    canonicalShape(piece_shapes::TABLE.size),
+    notLastColumn(0),
+    notFirstColumn(0),
+    startShape(0),
+    firstShape(0),
+    nShapes(0),
+    isPending(piece_shapes::MAX_ORIENTATIONS*GameState::MAX_HEIGHT, false),
+    nReachable(0),
+    landed((piece_shapes::TABLE.size*gameBox.size() + 63) / 64),
+    searched(false),
+    nExpanded(0),
+    visited(landed.size()),
+    landedNode(piece_shapes::TABLE.size*gameBox.size()),
+    restingZ(piece_shapes::TABLE.size*gameBox.size())
+{
+    using piece_shapes::TABLE;
+    assert( dims.x*dims.y <= 64 && dims.z <= GameState::MAX_HEIGHT );
+
+    for (int y = 0; y < dims.y; ++y) {
+        notLastColumn |= ((uint64_t(1) << (dims.x - 1)) - 1) << (y*dims.x);
+        notFirstColumn |= ((uint64_t(1) << (dims.x - 1)) - 1) << (y*dims.x + 1);
+    }
+
+    for (int shape = 0; shape < TABLE.size; ++shape) {
+        const auto &orientation = TABLE.orientations[shape];
+        for (int y = -orientation.min.y; y + orientation.max.y < dims.y; ++y)
+            for (int x = -orientation.min.x; x + orientation.max.x < dims.x; ++x)
+                inBounds[shape] |= uint64_t(1) << (y*dims.x + x);
+    }
+
+    // orientations of a prototype can be translated copies of each other
+    // and then produce the same placements
+    auto sameBlocks = [](const piece_shapes::Orientation &a, const piece_shapes::Orientation &b) {
+        for (int i = 0; i < piece_shapes::N_BLOCKS; ++i) {
+            const Pos3d &pa = a.blocks[i], &pb = b.blocks[i];
+            if (pa.x - a.min.x != pb.x - b.min.x ||
+                pa.y - a.min.y != pb.y - b.min.y ||
+                pa.z - a.min.z != pb.z - b.min.z) return false;
+        }
+        return true;
+    };
+
+    for (int shape = 0; shape < TABLE.size; ++shape) {
+        const auto &orientation = TABLE.orientations[shape];
+        int canonical = TABLE.first[orientation.prototype];
+        while (!sameBlocks(TABLE.orientations[canonical], orientation)) canonical++;
+        canonicalShape[shape] = canonical;
+    }
+}
+
+int PlacementGenerator::poseIndex(int shape, Pos3d min) const {
+    const Pos3d &dims = gameBox.dims;
+    assert( gameBox.contains(min) );
+    return ((shape*dims.z + min.z)*dims.y + min.y)*dims.x + min.x;
+}
+
+// the cells of a resting pose, the same for all orientations with the same
+// canonical shape and bounding box
+int PlacementGenerator::landedIndex(int shape, Pos3d center) const {
+    return poseIndex(canonicalShape[shape], pos_methods::sum(center, shapeMasks[shape].min));
+}
+
+// same as CementedBlockArray::pieceFits
+bool PlacementGenerator::fits(const uint64_t *layers, int shape, Pos3d center) const {
+    return piece_shapes::shapeFits(shapeMasks[shape], center, gameBox.dims, layers);
+}
+
+int PlacementGenerator::place(const Placement &placement, uint64_t *layers) const {
+    const piece_shapes::ShapeMask &mask = shapeMasks[placement.shape];
+    const Pos3d &dims = gameBox.dims;
+    const Pos3d min = pos_methods::sum(placement.center, mask.min);
+    const int shift = min.y*dims.x + min.x;
+    const int nLayers = mask.max.z - mask.min.z + 1;
+    for (int i = 0; i < nLayers; ++i) layers[min.z + i] |= mask.layers[i] << shift;
+
+    // only the layers of the piece can have become full
+    const uint64_t full = dims.x*dims.y == 64 ?
+        ~uint64_t(0) : (uint64_t(1) << (dims.x*dims.y)) - 1;
+    int dst = min.z;
+    for (int z = min.z; z < dims.z; ++z) {
+        if (z < min.z + nLayers && layers[z] == full) continue;
+        layers[dst++] = layers[z];
+    }
+    const int nRemoved = dims.z - dst;
+    for (int z = dst; z < dims.z; ++z) layers[z] = 0;
+    return nRemoved;
+}
+
+// centers (bit y*dims.x + x) where the orientation fits at height z. The
+// piece collides at center c if some block b has a cemented block at c + b,
+// i.e., the layer of b shifted back by b. Centers within the bounds keep
+// c + b inside the layer so the shifts do not wrap rows there. On wide
+// boards the offset can reach 64 bits, and then no center in the layer has
+// the block inside it
+uint64_t PlacementGenerator::fittingCenters(int shape, int z) const {
+    const auto &orientation = piece_shapes::TABLE.orientations[shape];
+    const Pos3d &dims = gameBox.dims;
+    if (z + orientation.min.z < 0 || z + orientation.max.z >= dims.z) return 0;
+
+    uint64_t collides = 0;
+    for (Pos3d b : orientation.blocks) {
+        const uint64_t layer = layers[z + b.z];
+        const int offset = b.y*dims.x + b.x;
+        if (offset >= 64 || offset <= -64) continue;
+        collides |= offset >= 0 ? layer >> offset : layer << -offset;
+    }
+    return inBounds[shape] & ~collides;
+}
+
+void PlacementGenerator::reach(int shape, int z, uint64_t centers) {
+    const int plane = (shape - firstShape)*gameBox.dims.z + z;
+    centers &= fitting[plane] & ~reachable[plane];
+    if (centers == 0) return;
+    reachable[plane] |= centers;
+    if (!isPending[plane]) {
+        isPending[plane] = true;
+        pending.push_back(plane);
+    }
+}
+
+const std::vector<Placement> &PlacementGenerator::generate(const GameState &state) {
+    using piece_shapes::TABLE;
+    const Pos3d d = state.dimensions;
+    if (d.x != gameBox.dims.x || d.y != gameBox.dims.y || d.z != gameBox.dims.z) abort();
+
+    placements.clear();
+    nReachable = 0;
+    searched = false;
+    std::fill(landed.begin(), landed.end(), 0);
+    startShape = state.activeShape;
+    startCenter = state.activeCenter;
+    std::copy(state.layers, state.layers + d.z, layers);
+    if (!state.alive || !fits(startShape, startCenter)) return placements;
+
+    const int prototype = TABLE.orientations[startShape].prototype;
+    firstShape = TABLE.first[prototype];
+    nShapes = TABLE.count[prototype];
+    for (int i = 0; i < nShapes; ++i) {
+        for (int z = 0; z < d.z; ++z) {
+            fitting[i*d.z + z] = fittingCenters(firstShape + i, z);
+            reachable[i*d.z + z] = 0;
+        }
+    }
+
+    reach(startShape, startCenter.z, uint64_t(1) << (startCenter.y*d.x + startCenter.x));
+    while (!pending.empty()) {
+        const int plane = pending.back();
+        pending.pop_back();
+        isPending[plane] = false;
+        const int shape = firstShape + plane / d.z, z = plane % d.z;
+        const auto &orientation = TABLE.orientations[shape];
+
+        // moves within the plane until nothing new is reached. A single
+        // row has no y moves, and shifting by a 64 wide row is undefined
+        const uint64_t fit = fitting[plane];
+        const int rowShift = d.y > 1 ? d.x : 0;
+        uint64_t centers = reachable[plane];
+        for (;;) {
+            const uint64_t next = centers | (fit & (
+                ((centers & notLastColumn) << 1) | ((centers & notFirstColumn) >> 1) |
+                (centers << rowShift) | (centers >> rowShift)));
+            if (next == centers) break;
+            centers = next;
+        }
+        reachable[plane] = centers;
+
+        // gravity
+        if (z > 0) reach(shape, z - 1, centers);
+
+        // rotations, with the same rules as GameBox::translateToBounds.
+        // Centers out of the bounds of the new orientation are moved back
+        // one by one, the others stay. Orientations larger than the board
+        // fit nowhere
+        for (int r = 0; r < piece_shapes::N_ROTATIONS; ++r) {
+            const int rotated = orientation.next[r];
+            const uint64_t rotatedInBounds = inBounds[rotated];
+            if (rotatedInBounds == 0) continue;
+            const int rotatedZ = gameBox.translateToBounds(rotated, Pos3d { 0, 0, z }).z;
+            uint64_t moved = centers & rotatedInBounds;
+            for (uint64_t rest = centers & ~rotatedInBounds; rest != 0; rest &= rest - 1) {
+                const int bit = __builtin_ctzll(rest);
+                const Pos3d c = gameBox.translateToBounds(rotated, Pos3d { bit % d.x, bit / d.x, z });
+                moved |= uint64_t(1) << (c.y*d.x + c.x);
+            }
+            reach(rotated, rotatedZ, moved);
+        }
+    }
+
+    // the resting poses are reachable too by letting gravity move the piece
+    // down, so dropping from anywhere lands on one of them
+    for (int i = 0; i < nShapes; ++i) {
+        const int shape = firstShape + i;
+        for (int z = 0; z < d.z; ++z) {
+            const uint64_t centers = reachable[i*d.z + z];
+            nReachable += __builtin_popcountll(centers);
+            const uint64_t resting = centers & ~(z > 0 ? fitting[i*d.z + z - 1] : 0);
+            for (uint64_t rest = resting; rest != 0; rest &= rest - 1) {
+                const int bit = __builtin_ctzll(rest);
+                const Pos3d center { bit % d.x, bit / d.x, z };
+                if (!testAndSet(landed, landedIndex(shape, center))) {
+                    placements.push_back(Placement { shape, center });
+                }
+            }
+        }
+    }
+    return placements;
+}
+
+int PlacementGenerator::getRestingZ(int shape, Pos3d center) {
+    // memoized over the poses below, each pose is tested only once
+    int8_t &z = restingZ[poseIndex(shape, pos_methods::sum(center, shapeMasks[shape].min))];
+    if (z < 0) {
+        const Pos3d below { center.x, center.y, center.z - 1 };
+        z = static_cast<int8_t>(fits(shape, below) ? getRestingZ(shape, below) : center.z);
+    }
+    return z;
+}
+
+void PlacementGenerator::visit(int shape, Pos3d center, int parent, PlacementInput input) {
+    if (!fits(shape, center)) return;
+    // index by the bounding box corner, which is inside the game box
+    // for all fitting poses
+    if (testAndSet(visited, poseIndex(shape, pos_methods::sum(center, shapeMasks[shape].min)))) return;
+    nodes.push_back(Node { shape, center, parent, input });
+}
+
+void PlacementGenerator::searchUntil(int target) {
+    using piece_shapes::TABLE;
+    if (!searched) {
+        nodes.clear();
+        nExpanded = 0;
+        std::fill(visited.begin(), visited.end(), 0);
+        std::fill(restingZ.begin(), restingZ.end(), -1);
+        // landed is reused for the placements seen by the search
+        std::fill(landed.begin(), landed.end(), 0);
+        visit(startShape, startCenter, -1, PlacementInput::DROP);
+        searched = true;
+    }
+
+    // the moves and rotations work on the shape index and center directly,
+    // with the same rules as Piece::rotated and GameBox::translateToBounds
+    while (nExpanded < nodes.size() && !isSet(landed, target)) {
+        const int current = static_cast<int>(nExpanded++);
+        // copy, nodes may be reallocated by visit
+        const int shape = nodes[current].shape;
+        const Pos3d c = nodes[current].center;
+        const auto &orientation = TABLE.orientations[shape];
+
+        const int index = landedIndex(shape, Pos3d { c.x, c.y, getRestingZ(shape, c) });
+        if (!testAndSet(landed, index)) landedNode[index] = current;
+
+        visit(shape, Pos3d { c.x + 1, c.y, c.z }, current, PlacementInput::MOVE_X_POS);
+        visit(shape, Pos3d { c.x - 1, c.y, c.z }, current, PlacementInput::MOVE_X_NEG);
+        visit(shape, Pos3d { c.x, c.y + 1, c.z }, current, PlacementInput::MOVE_Y_POS);
+        visit(shape, Pos3d { c.x, c.y - 1, c.z }, current, PlacementInput::MOVE_Y_NEG);
+        for (int r = 0; r < piece_shapes::N_ROTATIONS; ++r) {
+            const int rotated = orientation.next[r];
+            visit(rotated, gameBox.translateToBounds(rotated, c), current,
+                static_cast<PlacementInput>(static_cast<int>(PlacementInput::ROTATE_X_CW) + r));
+        }
+        visit(shape, Pos3d { c.x, c.y, c.z - 1 }, current, PlacementInput::WAIT);
+    }
+    // the placement must be from the last generate
+    assert( isSet(landed, target) );
+}
+
+void PlacementGenerator::getInputs(const Placement &placement, std::vector<PlacementInput> &inputs) {
+    const int target = landedIndex(placement.shape, placement.center);
+    searchUntil(target);
+    const std::size_t start = inputs.size();
+    for (int node = landedNode[target];
+        nodes[node].parent >= 0; node = nodes[node].parent)
+    {
+        inputs.push_back(nodes[node].input);
+    }
+    std::reverse(inputs.begin() + start, inputs.end());
+    inputs.push_back(PlacementInput::DROP);
+}
+
+namespace placements {
+    void applyInput(Game &game, PlacementInput input) {
+        switch (input) {
+        case PlacementInput::MOVE_X_POS: game.moveXY(1, 0); break;
+        case PlacementInput::MOVE_X_NEG: game.moveXY(-1, 0); break;
+        case PlacementInput::MOVE_Y_POS: game.moveXY(0, 1); break;
+        case PlacementInput::MOVE_Y_NEG: game.moveXY(0, -1); break;
+        case PlacementInput::WAIT: game.advanceToNextEvent(); break;
+        case PlacementInput::DROP: game.drop(); break;
+        default: {
+            const int r = static_cast<int>(input) - static_cast<int>(PlacementInput::ROTATE_X_CW);
+            const Rotation rot = piece_shapes::indexToRotation(r);
+            game.rotate(rot.axis, rot.direction);
+        }
+        }
+    }
+}
@@ -0,0 +1,306 @@
+#include "value-network.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <assert.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define VALUE_NETWORK_X86
+#include <immintrin.h>
+#endif
+
+const int ValueNetwork::INPUT_ALIGNMENT;
+const int ValueNetwork::MAX_HIDDEN;
+
+namespace value_network {
+    const char MAGIC[8] = { '3', 'D', 'T', 'R', 'I', 'S', 'N', 'N' };
+    const uint32_t VERSION = 1;
+    const int MAX_INPUTS = GameState::MAX_CELLS + 64;
+
+    int padInputs(int n) {
+        const int a = ValueNetwork::INPUT_ALIGNMENT;
+        return (n + a - 1) / a * a;
+    }
+
+    std::size_t fileSize(Pos3d dims, int nHidden1, int nHidden2) {
+        const int nInputs = dims.x*dims.y*dims.z + dims.x*dims.y;
+        return sizeof(ValueNetwork::FileHeader) +
+            std::size_t(nHidden1)*padInputs(nInputs) +
+            sizeof(float)*(2*nHidden1 + nHidden2*nHidden1 + nHidden2 + nHidden2 + 1);
+    }
+
+    // the occupancy, then the column heights of the layers in the GameState
+    // layout, input must be zeroed
+    void encode(const uint64_t *layers, Pos3d dims, uint8_t *input) {
+        const int layerSize = dims.x*dims.y;
+        uint8_t *heights = input + layerSize*dims.z;
+        uint64_t above = 0;
+        for (int z = dims.z - 1; z >= 0; --z) {
+            const uint64_t layer = layers[z];
+            for (uint64_t rest = layer; rest != 0; rest &= rest - 1) {
+                input[z*layerSize + __builtin_ctzll(rest)] = 1;
+            }
+            for (uint64_t top = layer & ~above; top != 0; top &= top - 1) {
+                heights[__builtin_ctzll(top)] = static_cast<uint8_t>(z + 1);
+            }
+            above |= layer;
+        }
+    }
+
+    void layer1Scalar(const uint8_t *input, const int8_t *w, int nInputs, int nHidden,
+        const float *scale, const float *bias, float *out)
+    {
+        for (int j = 0; j < nHidden; ++j) {
+            const int8_t *row = w + j*nInputs;
+            int32_t acc = 0;
+            for (int i = 0; i < nInputs; ++i) acc += int32_t(input[i]) * row[i];
+            out[j] = std::max(scale[j]*acc + bias[j], 0.0f);
+        }
+    }
+
+    float dotScalar(const float *a, const float *b, int n) {
+        float sum = 0;
+        for (int i = 0; i < n; ++i) sum += a[i]*b[i];
+        return sum;
+    }
+
+#ifdef VALUE_NETWORK_X86
+    // the inputs are at most 32 (a column height), so the pairwise sums of
+    // maddubs cannot saturate
+    __attribute__((target("avx2")))
+    void layer1Avx2(const uint8_t *input, const int8_t *w, int nInputs, int nHidden,
+        const float *scale, const float *bias, float *out)
+    {
+        const __m256i ones = _mm256_set1_epi16(1);
+        // four neurons per pass share the input loads
+        int j = 0;
+        for (; j + 4 <= nHidden; j += 4) {
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+            const int8_t *row = w + j*nInputs;
+            for (int i = 0; i < nInputs; i += 32) {
+                const __m256i x = _mm256_loadu_si256((const __m256i*)(input + i));
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_maddubs_epi16(x,
+                    _mm256_loadu_si256((const __m256i*)(row + i))), ones));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_maddubs_epi16(x,
+                    _mm256_loadu_si256((const __m256i*)(row + nInputs + i))), ones));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_maddubs_epi16(x,
+                    _mm256_loadu_si256((const __m256i*)(row + 2*nInputs + i))), ones));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_maddubs_epi16(x,
+                    _mm256_loadu_si256((const __m256i*)(row + 3*nInputs + i))), ones));
+            }
+            // horizontal sums of the four accumulators at once
+            const __m256i s01 = _mm256_hadd_epi32(acc0, acc1), s23 = _mm256_hadd_epi32(acc2, acc3);
+            const __m256i s = _mm256_hadd_epi32(s01, s23);
+            const __m128i sums = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+            const __m128 values = _mm_add_ps(
+                _mm_mul_ps(_mm_loadu_ps(scale + j), _mm_cvtepi32_ps(sums)), _mm_loadu_ps(bias + j));
+            _mm_storeu_ps(out + j, _mm_max_ps(values, _mm_setzero_ps()));
+        }
+        if (j < nHidden) {
+            layer1Scalar(input, w + j*nInputs, nInputs, nHidden - j, scale + j, bias + j, out + j);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    float dotAvx2(const float *a, const float *b, int n) {
+        __m256 sum = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        }
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s) + dotScalar(a + i, b + i, n - i);
+    }
+#endif
+}
+
+ValueNetwork::Simd ValueNetwork::bestSimd() {
+#ifdef VALUE_NETWORK_X86
+    if (__builtin_cpu_supports("avx2")) return Simd::AVX2;
+#endif
+    return Simd::SCALAR;
+}
+
+ValueNetwork::ValueNetwork(Simd simd_)
+:
+    simd(simd_),
+    mapping(nullptr),
+    mappingSize(0),
+    dims { 0, 0, 0 },
+    nInputs(0),
+    paddedInputs(0),
+    nHidden1(0),
+    nHidden2(0),
+    w1(nullptr),
+    scale1(nullptr), bias1(nullptr), w2(nullptr), bias2(nullptr), w3(nullptr),
+    bias3(0)
+{
+#ifndef VALUE_NETWORK_X86
+    // no SIMD implementations on this platform
+    if (simd != Simd::SCALAR) abort();
+#endif
+}
+
+ValueNetwork::~ValueNetwork() {
+    unload();
+}
+
+void ValueNetwork::unload() {
+    if (mapping != nullptr) munmap(mapping, mappingSize);
+    mapping = nullptr;
+    mappingSize = 0;
+}
+
+bool ValueNetwork::load(const char *path) {
+    using namespace value_network;
+    unload();
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && std::size_t(info.st_size) >= sizeof(FileHeader)) {
+        data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // the mapping stays valid after the file is closed
+    close(fd);
+    if (data == MAP_FAILED) return false;
+    const std::size_t size = info.st_size;
+
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    const Pos3d d { header.dimX, header.dimY, header.dimZ };
+    const bool valid =
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+        header.version == VERSION &&
+        GameState::isSupported(d) &&
+        header.nHidden1 > 0 && header.nHidden1 <= MAX_HIDDEN &&
+        header.nHidden2 > 0 && header.nHidden2 <= MAX_HIDDEN &&
+        size == fileSize(d, header.nHidden1, header.nHidden2);
+    if (!valid) {
+        munmap(data, size);
+        return false;
+    }
+
+    mapping = data;
+    mappingSize = size;
+    dims = d;
+    nInputs = d.x*d.y*d.z + d.x*d.y;
+    paddedInputs = padInputs(nInputs);
+    nHidden1 = header.nHidden1;
+    nHidden2 = header.nHidden2;
+
+    const char *p = static_cast<const char*>(data) + sizeof(FileHeader);
+    w1 = reinterpret_cast<const int8_t*>(p);
+    p += std::size_t(nHidden1)*paddedInputs;
+    // the floats are 4-byte aligned since the int8 rows are padded
+    const float *f = reinterpret_cast<const float*>(p);
+    scale1 = f; f += nHidden1;
+    bias1 = f; f += nHidden1;
+    w2 = f; f += nHidden2*nHidden1;
+    bias2 = f; f += nHidden2;
+    w3 = f; f += nHidden2;
+    bias3 = *f;
+    return true;
+}
+
+bool ValueNetwork::write(const char *path, const Weights &w) {
+    using namespace value_network;
+    const Pos3d d = w.dimensions;
+    const int n = d.x*d.y*d.z + d.x*d.y, padded = padInputs(n);
+    assert( int(w.w1.size()) == w.nHidden1*n );
+    assert( int(w.w2.size()) == w.nHidden2*w.nHidden1 );
+
+    FileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.dimX = d.x;
+    header.dimY = d.y;
+    header.dimZ = d.z;
+    header.nHidden1 = w.nHidden1;
+    header.nHidden2 = w.nHidden2;
+
+    FILE *file = std::fopen(path, "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    std::vector<int8_t> row(padded, 0);
+    for (int j = 0; j < w.nHidden1; ++j) {
+        std::copy(w.w1.begin() + j*n, w.w1.begin() + (j + 1)*n, row.begin());
+        ok = ok && std::fwrite(row.data(), 1, padded, file) == std::size_t(padded);
+    }
+    auto writeFloats = [&](const float *values, std::size_t count) {
+        ok = ok && std::fwrite(values, sizeof(float), count, file) == count;
+    };
+    writeFloats(w.scale1.data(), w.nHidden1);
+    writeFloats(w.bias1.data(), w.nHidden1);
+    writeFloats(w.w2.data(), w.w2.size());
+    writeFloats(w.bias2.data(), w.nHidden2);
+    writeFloats(w.w3.data(), w.nHidden2);
+    writeFloats(&w.bias3, 1);
+    return std::fclose(file) == 0 && ok;
+}
+
+float ValueNetwork::forward(const uint8_t *input) const {
+    using namespace value_network;
+    float h1[MAX_HIDDEN], h2[MAX_HIDDEN];
+    float (*dot)(const float*, const float*, int) = &dotScalar;
+
+#ifdef VALUE_NETWORK_X86
+    if (simd == Simd::AVX2) {
+        layer1Avx2(input, w1, paddedInputs, nHidden1, scale1, bias1, h1);
+        dot = &dotAvx2;
+    } else
+#endif
+    {
+        layer1Scalar(input, w1, paddedInputs, nHidden1, scale1, bias1, h1);
+    }
+
+    for (int k = 0; k < nHidden2; ++k) {
+        h2[k] = std::max(dot(w2 + k*nHidden1, h1, nHidden1) + bias2[k], 0.0f);
+    }
+    return dot(w3, h2, nHidden2) + bias3;
+}
+
+void ValueNetwork::evaluateBatch(const uint64_t *layers, int nBoards, float *values) const {
+    assert( isLoaded() );
+    uint8_t input[value_network::MAX_INPUTS];
+    for (int b = 0; b < nBoards; ++b) {
+        std::memset(input, 0, paddedInputs);
+        value_network::encode(layers + b*dims.z, dims, input);
+        values[b] = forward(input);
+    }
+}
+
+float ValueNetwork::evaluate(const uint64_t *layers) const {
+    float value;
+    evaluateBatch(layers, 1, &value);
+    return value;
+}
+
+float ValueNetwork::evaluate(const CementedBlockArray &blocks) const {
+    assert( isLoaded() );
+    const Pos3d d = blocks.getDimensions();
+    if (d.x != dims.x || d.y != dims.y || d.z != dims.z) abort();
+    const int layerSize = dims.x*dims.y;
+    // the layers and column heights are in the GameState layout
+    const LayerMask *layers = blocks.getLayers();
+    const int *heights = blocks.getColumnHeights();
+
+    uint8_t input[value_network::MAX_INPUTS];
+    std::memset(input, 0, paddedInputs);
+    for (int z = 0; z < dims.z; ++z) {
+        for (LayerMask rest = layers[z]; rest != 0; rest &= rest - 1) {
+            input[z*layerSize + __builtin_ctzll(rest)] = 1;
+        }
+    }
+    for (int i = 0; i < layerSize; ++i) input[layerSize*dims.z + i] = static_cast<uint8_t>(heights[i]);
+    return forward(input);
+}
@@ -0,0 +1,173 @@
+#include "work-stealing-pool.hpp"
+#include <assert.h>
+#include <iterator>
+
+namespace {
+    thread_local const WorkStealingPool *currentPool = nullptr;
+    thread_local int currentWorker = -1;
+}
+
+WorkStealingPool::WorkStealingPool(int nThreads)
+:
+    nextQueue(0),
+    nQueued(0),
+    nSleeping(0),
+    stopping(false)
+{
+    if (nThreads <= 0) nThreads = static_cast<int>(std::thread::hardware_concurrency());
+    if (nThreads <= 0) nThreads = 1;
+
+    for (int i = 0; i < nThreads; ++i) queues.emplace_back(new TaskQueue());
+    for (int i = 0; i < nThreads; ++i) threads.emplace_back([this, i]() { workerLoop(i); });
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (std::thread &t : threads) t.join();
+}
+
+int WorkStealingPool::getWorkerIndex() const {
+    return currentPool == this ? currentWorker : -1;
+}
+
+void WorkStealingPool::submit(Task task) {
+    push(std::move(task), nullptr);
+}
+
+void WorkStealingPool::push(Task task, const TaskGroup *group) {
+    int index = getWorkerIndex();
+    if (index < 0) index = nextQueue++ % queues.size();
+
+    // count the task before it can be taken so that the count never
+    // goes negative. Waiting workers may spin until it is pushed
+    nQueued++;
+    {
+        std::lock_guard<std::mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(Entry { std::move(task), group });
+    }
+    // a worker increments nSleeping before it checks nQueued, under the
+    // mutex, so either it sees this task or it is woken here
+    if (nSleeping > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wakeUp.notify_one();
+    }
+}
+
+bool WorkStealingPool::popOwn(int index, const TaskGroup *group, Task &task) {
+    TaskQueue &queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it) {
+        if (group != nullptr && it->group != group) continue;
+        task = std::move(it->task);
+        queue.tasks.erase(std::next(it).base());
+        return true;
+    }
+    return false;
+}
+
+bool WorkStealingPool::steal(int thief, const TaskGroup *group, Task &task) {
+    const int n = static_cast<int>(queues.size());
+    const int first = thief < 0 ? 0 : thief + 1;
+    for (int i = 0; i < n; ++i) {
+        TaskQueue &queue = *queues[(first + i) % n];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) continue;
+        if (group == nullptr) {
+            task = std::move(queue.tasks.front().task);
+            queue.tasks.pop_front();
+            return true;
+        }
+        // the tasks of a group were queued recently, look from the back
+        for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it) {
+            if (it->group != group) continue;
+            task = std::move(it->task);
+            queue.tasks.erase(std::next(it).base());
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkStealingPool::runPendingTask() {
+    return runTask(nullptr);
+}
+
+bool WorkStealingPool::runTask(const TaskGroup *group) {
+    const int index = getWorkerIndex();
+    Task task;
+    if ((index >= 0 && popOwn(index, group, task)) || steal(index, group, task)) {
+        const int nLeft = --nQueued;
+        assert(nLeft >= 0);
+        (void)nLeft;
+        task();
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    currentPool = this;
+    currentWorker = index;
+    while (true) {
+        if (runPendingTask()) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        nSleeping++;
+        wakeUp.wait(lock, [this]() { return stopping || nQueued > 0; });
+        nSleeping--;
+        if (stopping && nQueued == 0) return;
+    }
+}
+
+TaskGroup::TaskGroup(WorkStealingPool &pool) : pool(pool), nPending(0), nQueued(0), nWaiting(0) {}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(WorkStealingPool::Task task) {
+    nPending++;
+    nQueued++;
+    pool.push([this, task]() {
+        nQueued--;
+        task();
+        finished();
+    }, this);
+    if (nWaiting > 0) {
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+}
+
+void TaskGroup::finished() {
+    // all but the last task decrement without the lock. The last one
+    // holds it so that wait() cannot return, and the group be destroyed,
+    // before the notification
+    int n = nPending;
+    while (n > 1 && !nPending.compare_exchange_weak(n, n - 1)) {}
+    if (n > 1) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    nPending--;
+    changed.notify_all();
+}
+
+void TaskGroup::wait() {
+    while (nPending > 0) {
+        if (pool.runTask(this)) continue;
+        if (nQueued > 0) {
+            // counted but not pushed yet, or taken but not started
+            std::this_thread::yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        nWaiting++;
+        changed.wait(lock, [this]() { return nPending == 0 || nQueued > 0; });
+        nWaiting--;
+    }
+    // the last task may still be notifying
+    std::lock_guard<std::mutex> lock(mutex);
+}
@@ -0,0 +1,76 @@
+#include "xoshiro.hpp"
+
+namespace xoshiro {
+    inline uint32_t rotl(uint32_t x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    uint64_t splitMix64(uint64_t &x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+}
+
+const int Xoshiro128::STATE_SIZE;
+
+Xoshiro128::Xoshiro128(uint64_t seed) {
+    for (int i = 0; i < STATE_SIZE; i += 2) {
+        const uint64_t word = xoshiro::splitMix64(seed);
+        s[i] = static_cast<uint32_t>(word);
+        s[i+1] = static_cast<uint32_t>(word >> 32);
+    }
+}
+
+uint32_t Xoshiro128::next() {
+    const uint32_t result = xoshiro::rotl(s[1] * 5, 7) * 9;
+    const uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = xoshiro::rotl(s[3], 11);
+
+    return result;
+}
+
+uint32_t Xoshiro128::nextBelow(uint32_t range) {
+    // Lemire's multiply-and-reject method, exact and portable
+    uint64_t m = static_cast<uint64_t>(next()) * range;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < range) {
+        const uint32_t threshold = (0u - range) % range;
+        while (low < threshold) {
+            m = static_cast<uint64_t>(next()) * range;
+            low = static_cast<uint32_t>(m);
+        }
+    }
+    return static_cast<uint32_t>(m >> 32);
+}
+
+void Xoshiro128::jump() {
+    static const uint32_t JUMP[] = { 0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b };
+
+    uint32_t t[STATE_SIZE] = { 0, 0, 0, 0 };
+    for (uint32_t word : JUMP) {
+        for (int b = 0; b < 32; ++b) {
+            if (word & (1u << b)) {
+                for (int i = 0; i < STATE_SIZE; ++i) t[i] ^= s[i];
+            }
+            next();
+        }
+    }
+    setState(t);
+}
+
+void Xoshiro128::getState(uint32_t state[STATE_SIZE]) const {
+    for (int i = 0; i < STATE_SIZE; ++i) state[i] = s[i];
+}
+
+void Xoshiro128::setState(const uint32_t state[STATE_SIZE]) {
+    for (int i = 0; i < STATE_SIZE; ++i) s[i] = state[i];
+}
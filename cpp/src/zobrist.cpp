@@ -0,0 +1,44 @@
+#include "zobrist.hpp"
+
+namespace {
+    // keys are generated on the fly with the SplitMix64 finalizer instead
+    // of being stored in tables
+    uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    const uint64_t CELL_SALT = 0x9e3779b97f4a7c15ull;
+    const uint64_t PIECE_SALT = 0xd1b54a32d192ed03ull;
+}
+
+uint64_t zobrist::cellKey(int cell) {
+    return mix(CELL_SALT * (uint64_t(cell) + 1));
+}
+
+uint64_t zobrist::pieceKey(int shape, Pos3d center) {
+    // coordinates are small, offset them so that negative ones pack too
+    const uint64_t packed =
+        (uint64_t(shape) << 48) |
+        ((uint64_t(center.x + 0x8000) & 0xffff) << 32) |
+        ((uint64_t(center.y + 0x8000) & 0xffff) << 16) |
+        (uint64_t(center.z + 0x8000) & 0xffff);
+    return mix(PIECE_SALT ^ mix(packed));
+}
+
+uint64_t zobrist::boardKey(const uint64_t *layers, Pos3d dims) {
+    const int layerSize = dims.x*dims.y;
+    uint64_t key = 0;
+    for (int z = 0; z < dims.z; ++z) {
+        for (uint64_t rest = layers[z]; rest != 0; rest &= rest - 1) {
+            key ^= cellKey(z*layerSize + __builtin_ctzll(rest));
+        }
+    }
+    return key;
+}
+
+uint64_t zobrist::stateKey(const GameState &state) {
+    return boardKey(state.layers, state.dimensions) ^
+        pieceKey(state.activeShape, state.activeCenter);
+}
@@ -1,7 +1,80 @@
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 #include "piece.hpp"
+#include "piece-shapes.hpp"
 #include "game.hpp"
+#include "game-config.hpp"
+#include "game-batch.hpp"
+#include "placement-generator.hpp"
+#include "board-features.hpp"
+#include "autoplayer.hpp"
+#include "expectimax.hpp"
+#include "arena.hpp"
+#include "mcts-search.hpp"
+#include "transposition-table.hpp"
+#include "zobrist.hpp"
+#include "hint-service.hpp"
+#include "value-network.hpp"
+#include "xoshiro.hpp"
+#include "work-stealing-pool.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <random>
+#include <set>
+#include <type_traits>
+#include <unistd.h>
+
+// count heap allocations to check that the game logic does not allocate
+static std::atomic<std::size_t> nAllocations(0);
+
+void* operator new(std::size_t size) {
+    nAllocations++;
+    void *ptr = std::malloc(size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    nAllocations++;
+    return std::malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+// all the replaced allocations come from malloc, so every form of delete
+// must free them
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept {
+    std::free(ptr);
+}
 
 TEST_CASE( "Pos3d", "[pos-3d]" ) {
     SECTION("sum") {
@@ -106,6 +179,87 @@ TEST_CASE( "Piece", "[piece]" ) {
     }
 }
 
+TEST_CASE( "PieceShapes", "[piece-shapes]" ) {
+    using piece_shapes::TABLE;
+
+    SECTION("orientation counts") {
+        int total = 0;
+        for (int proto = 0; proto < piece_shapes::N_PROTOTYPES; ++proto) {
+            REQUIRE( 24 % TABLE.count[proto] == 0 );
+            REQUIRE( TABLE.first[proto] == total );
+            total += TABLE.count[proto];
+        }
+        REQUIRE( TABLE.size == total );
+        REQUIRE( TABLE.count[1] == 6 ); // ####
+        REQUIRE( TABLE.count[4] == 12 ); // ## / ##
+    }
+
+    SECTION("transitions match block rotation") {
+        for (int shape = 0; shape < TABLE.size; ++shape) {
+            for (int r = 0; r < piece_shapes::N_ROTATIONS; ++r) {
+                const Rotation rot = piece_shapes::indexToRotation(r);
+                REQUIRE( piece_shapes::rotationIndex(rot) == r );
+
+                const Piece tabled = Piece(Pos3d { 1, 2, 3 }, shape, 7).rotated(rot);
+                const Piece generic = Piece(
+                    Pos3d { 1, 2, 3 },
+                    Piece(Pos3d { 0, 0, 0 }, shape, 7).getBlocks()).rotated(rot);
+
+                REQUIRE( tabled.getShape() == TABLE.orientations[shape].next[r] );
+                REQUIRE( generic.getShape() == Piece::NO_SHAPE );
+
+                int nMatching = 0;
+                for (Block a : tabled.getBlocks()) {
+                    for (Block b : generic.getBlocks()) {
+                        if (a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.pos.z == b.pos.z)
+                            nMatching++;
+                    }
+                    REQUIRE( a.pieceId == 7 );
+                }
+                REQUIRE( nMatching == piece_shapes::N_BLOCKS );
+
+                for (Axis axis : { Axis::X, Axis::Y, Axis::Z }) {
+                    for (int dir : { -1, 1 }) {
+                        REQUIRE( tabled.getExtent(axis, dir) == generic.getExtent(axis, dir) );
+                    }
+                }
+            }
+        }
+    }
+
+    SECTION("shape masks") {
+        const Pos3d dims { 5, 4, 6 };
+        const auto masks = piece_shapes::buildShapeMasks(dims);
+        REQUIRE( static_cast<int>(masks.size()) == TABLE.size );
+        std::vector<uint64_t> layers(dims.z, 0);
+        for (int shape = 0; shape < TABLE.size; ++shape) {
+            const auto &orientation = TABLE.orientations[shape];
+            for (int z = -1; z <= dims.z; ++z) {
+                for (int y = -1; y <= dims.y; ++y) {
+                    for (int x = -1; x <= dims.x; ++x) {
+                        const Pos3d center { x, y, z };
+                        bool inside = true;
+                        for (Pos3d b : orientation.blocks) {
+                            const Pos3d p = pos_methods::sum(center, b);
+                            inside = inside && p.x >= 0 && p.y >= 0 && p.z >= 0 &&
+                                p.x < dims.x && p.y < dims.y && p.z < dims.z;
+                        }
+                        REQUIRE( piece_shapes::shapeFits(masks[shape], center, dims, layers.data()) == inside );
+                        if (!inside) continue;
+
+                        // blocked by a single cell under any of the blocks
+                        for (Pos3d b : orientation.blocks) {
+                            const Pos3d p = pos_methods::sum(center, b);
+                            layers[p.z] = uint64_t(1) << (p.y*dims.x + p.x);
+                            REQUIRE( !piece_shapes::shapeFits(masks[shape], center, dims, layers.data()) );
+                            layers[p.z] = 0;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
 
 TEST_CASE( "GameBox", "[game-box]" ) {
     GameBox box(Pos3d { 5, 6, 15 });
@@ -204,6 +358,162 @@ TEST_CASE( "CementedBlockArray" "[cemented-block-array]") {
         REQUIRE( blocks.getNonEmptyBlocks().size() == 0 );
     }
 
+    SECTION("remove all full layers") {
+        GameBox box(Pos3d { 2, 1, 6 });
+        CementedBlockArray blocks(box);
+
+        for (int z : { 0, 2, 3, 5 }) {
+            blocks.setBlock(Block{Pos3d { 0, 0, z }, 10 + z});
+            blocks.setBlock(Block{Pos3d { 1, 0, z }, 10 + z});
+        }
+        blocks.setBlock(Block{Pos3d { 1, 0, 1 }, 1});
+        blocks.setBlock(Block{Pos3d { 0, 0, 4 }, 4});
+
+        REQUIRE( blocks.removeFullLayers() == 4 );
+        REQUIRE( blocks.removeFullLayers() == 0 );
+
+        auto ne = blocks.getNonEmptyBlocks();
+        REQUIRE( ne.size() == 2 );
+        REQUIRE( ne[0].pos.x == 1 );
+        REQUIRE( ne[0].pos.z == 0 );
+        REQUIRE( ne[0].pieceId == 1 );
+        REQUIRE( ne[1].pos.x == 0 );
+        REQUIRE( ne[1].pos.z == 1 );
+        REQUIRE( ne[1].pieceId == 4 );
+    }
+
+    SECTION("64-cell layers") {
+        GameBox box(Pos3d { 8, 8, 3 });
+        CementedBlockArray blocks(box);
+
+        for (int x = 0; x < 8; ++x) {
+            for (int y = 0; y < 8; ++y) {
+                blocks.setBlock(Block{Pos3d { x, y, 1 }, x + y});
+            }
+        }
+        blocks.setBlock(Block{Pos3d { 7, 7, 2 }, 5});
+        REQUIRE( !blocks.isLayerFull(0) );
+        REQUIRE( blocks.isLayerFull(1) );
+
+        blocks.removeLayer(1);
+        REQUIRE( !blocks.isLayerFull(1) );
+        auto ne = blocks.getNonEmptyBlocks();
+        REQUIRE( ne.size() == 1 );
+        REQUIRE( ne[0].pos.x == 7 );
+        REQUIRE( ne[0].pos.y == 7 );
+        REQUIRE( ne[0].pos.z == 1 );
+        REQUIRE( ne[0].pieceId == 5 );
+    }
+
+    SECTION("shape masks match block-wise fit") {
+        GameBox box(Pos3d { 5, 4, 6 });
+        CementedBlockArray blocks(box);
+        std::mt19937 rng(1);
+        for (int z = 0; z < box.dims.z; ++z) {
+            for (int y = 0; y < box.dims.y; ++y) {
+                for (int x = 0; x < box.dims.x; ++x) {
+                    if (rng() % 4 == 0) blocks.setBlock(Block{Pos3d { x, y, z }, 1});
+                }
+            }
+        }
+
+        int nFits = 0;
+        for (int shape = 0; shape < piece_shapes::TABLE.size; ++shape) {
+            for (int z = -3; z < box.dims.z + 3; ++z) {
+                for (int y = -3; y < box.dims.y + 3; ++y) {
+                    for (int x = -3; x < box.dims.x + 3; ++x) {
+                        const Piece masked(Pos3d { x, y, z }, shape, 2);
+                        const Piece generic(masked.getBlocks());
+                        const bool fits = blocks.pieceFits(masked);
+                        REQUIRE( fits == blocks.pieceFits(generic) );
+                        if (fits) nFits++;
+                    }
+                }
+            }
+        }
+        REQUIRE( nFits > 0 );
+    }
+
+    SECTION("column heights and drop distance") {
+        GameBox box(Pos3d { 3, 2, 8 });
+        CementedBlockArray blocks(box);
+
+        blocks.setBlock(Block{Pos3d { 0, 0, 2 }, 1});
+        blocks.setBlock(Block{Pos3d { 1, 0, 0 }, 1});
+        blocks.setBlock(Block{Pos3d { 0, 1, 5 }, 1});
+        REQUIRE( blocks.getColumnHeight(0, 0) == 3 );
+        REQUIRE( blocks.getColumnHeight(1, 0) == 1 );
+        REQUIRE( blocks.getColumnHeight(2, 1) == 0 );
+        REQUIRE( blocks.getColumnHeight(0, 1) == 6 );
+
+        Piece piece {{
+            Block { Pos3d{ 0, 0, 6 }, 2},
+            Block { Pos3d{ 1, 0, 6 }, 2},
+            Block { Pos3d{ 1, 0, 7 }, 2}
+        }};
+        REQUIRE( blocks.dropDistance(piece) == 3 );
+
+        // under the overhang at (0, 1, 5)
+        Piece tucked {{
+            Block { Pos3d{ 0, 1, 3 }, 3},
+            Block { Pos3d{ 1, 1, 3 }, 3}
+        }};
+        REQUIRE( blocks.dropDistance(tucked) == 3 );
+
+        blocks.setBlock(Block{Pos3d { 0, 0, 0 }, 1});
+        blocks.setBlock(Block{Pos3d { 0, 1, 0 }, 1});
+        blocks.setBlock(Block{Pos3d { 1, 1, 0 }, 1});
+        blocks.setBlock(Block{Pos3d { 2, 0, 0 }, 1});
+        blocks.setBlock(Block{Pos3d { 2, 1, 0 }, 1});
+        REQUIRE( blocks.removeFullLayers() == 1 );
+        REQUIRE( blocks.getColumnHeight(0, 0) == 2 );
+        REQUIRE( blocks.getColumnHeight(1, 0) == 0 );
+        REQUIRE( blocks.getColumnHeight(0, 1) == 5 );
+
+        blocks.removeLayer(1);
+        REQUIRE( blocks.getColumnHeight(0, 0) == 0 );
+        REQUIRE( blocks.getColumnHeight(0, 1) == 4 );
+    }
+
+    SECTION("change journal replay") {
+        GameBox box(Pos3d { 2, 2, 6 });
+        CementedBlockArray blocks(box);
+        std::mt19937 rng(2);
+
+        std::vector<int> mirror(box.size(), -1);
+        unsigned int seenVersion = 0;
+        int nRemoved = 0;
+
+        for (int i = 0; i < 200; ++i) {
+            const Pos3d pos {
+                static_cast<int>(rng() % 2),
+                static_cast<int>(rng() % 2),
+                static_cast<int>(rng() % 3)
+            };
+            blocks.setBlock(Block { pos, i });
+            if (i % 5 == 0) nRemoved += blocks.removeFullLayers();
+
+            std::vector<CementedChange> changes;
+            REQUIRE( blocks.getJournal().getChangesSince(seenVersion, changes) );
+            for (const CementedChange &c : changes) {
+                REQUIRE( c.version == ++seenVersion );
+                const Pos3d p = c.block.pos;
+                if (c.type == ChangeType::BLOCK_SET) {
+                    mirror[(p.z*2 + p.y)*2 + p.x] = c.block.pieceId;
+                } else {
+                    mirror.erase(mirror.begin() + p.z*4, mirror.begin() + (p.z + 1)*4);
+                    mirror.insert(mirror.end(), 4, -1);
+                }
+            }
+
+            std::vector<int> expected(mirror.size(), -1);
+            for (Block b : blocks.getNonEmptyBlocks())
+                expected[(b.pos.z*2 + b.pos.y)*2 + b.pos.x] = b.pieceId;
+            REQUIRE( mirror == expected );
+        }
+        REQUIRE( nRemoved > 1 );
+    }
+
     SECTION("piece fits and cement") {
         GameBox box(Pos3d { 2, 2, 3 });
         CementedBlockArray blocks(box);
@@ -231,6 +541,137 @@ TEST_CASE( "CementedBlockArray" "[cemented-block-array]") {
     }
 }
 
+TEST_CASE( "ChangeJournal", "[change-journal]" ) {
+    ChangeJournal journal(3);
+    REQUIRE( journal.getVersion() == 0 );
+
+    std::vector<CementedChange> changes;
+    REQUIRE( journal.getChangesSince(0, changes) );
+    REQUIRE( changes.empty() );
+
+    journal.blockSet(Block { Pos3d { 1, 2, 3 }, 4 });
+    journal.layerRemoved(5);
+    REQUIRE( journal.getVersion() == 2 );
+    REQUIRE( journal.getChangesSince(0, changes) );
+    REQUIRE( changes.size() == 2 );
+    REQUIRE( changes[0].version == 1 );
+    REQUIRE( changes[0].type == ChangeType::BLOCK_SET );
+    REQUIRE( changes[0].block.pos.y == 2 );
+    REQUIRE( changes[0].block.pieceId == 4 );
+    REQUIRE( changes[1].version == 2 );
+    REQUIRE( changes[1].type == ChangeType::LAYER_REMOVED );
+    REQUIRE( changes[1].block.pos.z == 5 );
+
+    journal.layerRemoved(1);
+    journal.layerRemoved(0);
+    changes.clear();
+    REQUIRE( !journal.getChangesSince(0, changes) );
+    REQUIRE( !journal.getChangesSince(5, changes) );
+    REQUIRE( journal.getChangesSince(1, changes) );
+    REQUIRE( changes.size() == 3 );
+    REQUIRE( changes[2].version == 4 );
+    REQUIRE( changes[2].block.pos.z == 0 );
+}
+
+TEST_CASE( "Xoshiro128", "[xoshiro]" ) {
+    // golden values, must be the same on all platforms and compilers
+
+    SECTION("reference state") {
+        Xoshiro128 rng(0);
+        const uint32_t state[] = { 1, 2, 3, 4 };
+        rng.setState(state);
+        REQUIRE( rng.next() == 11520u );
+    }
+
+    SECTION("seeded sequence") {
+        Xoshiro128 rng(0);
+        for (uint32_t expected : { 3737715805u, 2584255861u, 2876756834u, 3286328325u }) {
+            REQUIRE( rng.next() == expected );
+        }
+    }
+
+    SECTION("bounded") {
+        Xoshiro128 rng(42);
+        for (uint32_t expected : { 2, 6, 0, 3, 4, 4, 4, 3 }) {
+            REQUIRE( rng.nextBelow(7) == expected );
+        }
+    }
+
+    SECTION("jump") {
+        Xoshiro128 rng(0);
+        rng.jump();
+        REQUIRE( rng.next() == 3627099225u );
+        REQUIRE( rng.next() == 346338634u );
+    }
+}
+
+TEST_CASE( "WorkStealingPool", "[work-stealing-pool]" ) {
+    WorkStealingPool pool(4);
+    REQUIRE( pool.getThreadCount() == 4 );
+    REQUIRE( pool.getWorkerIndex() == -1 );
+
+    SECTION("task group") {
+        std::vector<int> results(1000, 0);
+        TaskGroup group(pool);
+        for (int i = 0; i < 1000; ++i) {
+            group.run([&results, i]() { results[i] = i * i; });
+        }
+        group.wait();
+        for (int i = 0; i < 1000; ++i) REQUIRE( results[i] == i * i );
+    }
+
+    SECTION("nested groups") {
+        std::atomic<int> nLeaves(0), nOnWorkers(0);
+        TaskGroup outer(pool);
+        for (int i = 0; i < 20; ++i) {
+            outer.run([&pool, &nLeaves, &nOnWorkers]() {
+                if (pool.getWorkerIndex() >= 0) nOnWorkers++;
+                // waiting inside a task must not deadlock the pool
+                TaskGroup inner(pool);
+                for (int j = 0; j < 50; ++j) inner.run([&nLeaves]() { nLeaves++; });
+                inner.wait();
+            });
+        }
+        outer.wait();
+        REQUIRE( nLeaves == 20 * 50 );
+        REQUIRE( nOnWorkers <= 20 );
+    }
+
+    SECTION("wait only runs the tasks of its group") {
+        // keep the only worker busy until the group is done
+        WorkStealingPool single(1);
+        std::atomic<bool> release(false);
+        std::atomic<int> nOther(0), nOtherOffWorkers(0);
+        single.submit([&release]() { while (!release) std::this_thread::yield(); });
+        for (int i = 0; i < 10; ++i) {
+            single.submit([&single, &nOther, &nOtherOffWorkers]() {
+                if (single.getWorkerIndex() < 0) nOtherOffWorkers++;
+                nOther++;
+            });
+        }
+        int nOwn = 0;
+        {
+            TaskGroup group(single);
+            for (int i = 0; i < 5; ++i) group.run([&nOwn]() { nOwn++; });
+            group.wait();
+        }
+        REQUIRE( nOwn == 5 );
+        REQUIRE( nOther == 0 );
+        release = true;
+        while (nOther < 10) std::this_thread::yield();
+        REQUIRE( nOtherOffWorkers == 0 );
+    }
+
+    SECTION("destroy with queued tasks") {
+        std::atomic<int> nRun(0);
+        {
+            WorkStealingPool small(2);
+            for (int i = 0; i < 100; ++i) small.submit([&nRun]() { nRun++; });
+        }
+        REQUIRE( nRun == 100 );
+    }
+}
+
 TEST_CASE( "ConcreteGame" "[concrete-game]") {
 
     SECTION("start") {
@@ -242,6 +683,30 @@ TEST_CASE( "ConcreteGame" "[concrete-game]") {
         REQUIRE( game->getActiveBlocks().size() == game->getAllBlocks().size() );
     }
 
+    SECTION("block visitors") {
+        std::unique_ptr<Game> game = buildGame(0);
+        game->drop();
+        game->drop();
+
+        std::vector<Block> visited;
+        game->forEachBlock([&visited](const Block &b) { visited.push_back(b); });
+
+        const auto all = game->getAllBlocks();
+        REQUIRE( visited.size() == all.size() );
+        for (std::size_t i = 0; i < all.size(); ++i) {
+            REQUIRE( visited[i].pos.x == all[i].pos.x );
+            REQUIRE( visited[i].pos.y == all[i].pos.y );
+            REQUIRE( visited[i].pos.z == all[i].pos.z );
+            REQUIRE( visited[i].pieceId == all[i].pieceId );
+        }
+
+        int nActive = 0, nCemented = 0;
+        game->forEachActiveBlock([&nActive](const Block&) { nActive++; });
+        game->forEachCementedBlock([&nCemented](const Block&) { nCemented++; });
+        REQUIRE( nActive == static_cast<int>(game->getActiveBlocks().size()) );
+        REQUIRE( nCemented == static_cast<int>(game->getCementedBlocks().size()) );
+    }
+
     SECTION("should end in 2-100 drops") {
         std::unique_ptr<Game> game = buildGame(0);
 
@@ -291,6 +756,84 @@ TEST_CASE( "ConcreteGame" "[concrete-game]") {
         }
     }
 
+    SECTION("large time steps") {
+        const int FRAME_MS = 10;
+        for (int stepMs : { 1000, 2500, 7777, 60*1000, 10*60*1000 }) {
+            ConcreteGame framed(3), stepped(3), advanced(3);
+
+            int t = 0;
+            for (int i = 0; i < 50 && !framed.isOver(); ++i) {
+                t += stepMs;
+                // the clock stops when the game ends
+                while (framed.getTimeMs() < t && !framed.isOver()) framed.tick(FRAME_MS);
+
+                REQUIRE( stepped.tick(stepMs) );
+                advanced.advanceTo(t);
+                REQUIRE( stepped.getTimeMs() == t );
+                REQUIRE( advanced.getTimeMs() == t );
+
+                for (Game *other : { (Game*)&stepped, (Game*)&advanced }) {
+                    const auto a = framed.getAllBlocks(), b = other->getAllBlocks();
+                    REQUIRE( a.size() == b.size() );
+                    for (std::size_t j = 0; j < a.size(); ++j) {
+                        REQUIRE( a[j].pos.x == b[j].pos.x );
+                        REQUIRE( a[j].pos.y == b[j].pos.y );
+                        REQUIRE( a[j].pos.z == b[j].pos.z );
+                    }
+                    REQUIRE( framed.getScore() == other->getScore() );
+                    REQUIRE( framed.isOver() == other->isOver() );
+                }
+            }
+        }
+    }
+
+    SECTION("clock limits") {
+        ConcreteGame game(5);
+        REQUIRE( !game.tick(0) );
+        REQUIRE( !game.tick(-100) );
+        REQUIRE( game.getTimeMs() == 0 );
+
+        // a huge step saturates the clock instead of overflowing it
+        const int MAX = std::numeric_limits<int>::max();
+        game.tick(MAX - 500);
+        game.tick(MAX);
+        REQUIRE( game.isOver() );
+        REQUIRE( game.getTimeMs() <= MAX );
+
+        ConcreteGame over(6);
+        while (!over.isOver()) over.drop();
+        const int endMs = over.getTimeMs();
+        REQUIRE( !over.tick(MAX) );
+        REQUIRE( !over.advanceTo(endMs + 1000) );
+        REQUIRE( over.getTimeMs() == endMs );
+    }
+
+    SECTION("next event") {
+        ConcreteGame polled(4), scheduled(4);
+        REQUIRE( scheduled.msUntilNextEvent() == 1000 );
+        REQUIRE( !scheduled.tick(300) );
+        REQUIRE( scheduled.msUntilNextEvent() == 700 );
+        REQUIRE( !polled.tick(300) );
+
+        // wake up only for the timed events, same result as polling
+        int nEvents = 0;
+        while (!scheduled.isOver()) {
+            const int wakeUpMs = scheduled.getTimeMs() + scheduled.msUntilNextEvent();
+            while (polled.getTimeMs() < wakeUpMs - 10) REQUIRE( !polled.tick(10) );
+            REQUIRE( polled.tick(wakeUpMs - polled.getTimeMs()) );
+
+            REQUIRE( scheduled.advanceToNextEvent() );
+            REQUIRE( scheduled.getTimeMs() == wakeUpMs );
+            REQUIRE( scheduled.getAllBlocks().size() == polled.getAllBlocks().size() );
+            REQUIRE( scheduled.getScore() == polled.getScore() );
+            nEvents++;
+        }
+        REQUIRE( polled.isOver() );
+        REQUIRE( nEvents > 10 );
+        REQUIRE( scheduled.msUntilNextEvent() == -1 );
+        REQUIRE( !scheduled.advanceToNextEvent() );
+    }
+
     SECTION("move XY") {
         std::unique_ptr<Game> game = buildGame(0);
 
@@ -318,4 +861,1141 @@ TEST_CASE( "ConcreteGame" "[concrete-game]") {
         }
         REQUIRE( !game->isOver() );
     }
+    SECTION("versions") {
+        std::unique_ptr<Game> game = buildGame(1);
+        REQUIRE( game->getCementedVersion() == 0 );
+
+        unsigned int activeVersion = game->getActiveVersion();
+        REQUIRE( game->rotate(Axis::Z, RotationDirection::CW) );
+        REQUIRE( game->getActiveVersion() > activeVersion );
+        REQUIRE( game->getCementedVersion() == 0 );
+
+        activeVersion = game->getActiveVersion();
+        game->drop();
+        REQUIRE( game->getActiveVersion() > activeVersion );
+
+        std::vector<CementedChange> changes;
+        REQUIRE( game->getCementedChangesSince(0, changes) );
+        REQUIRE( changes.size() == game->getCementedBlocks().size() );
+        REQUIRE( changes.back().version == game->getCementedVersion() );
+    }
+
+    SECTION("build with dimensions") {
+        for (Pos3d dims : { Pos3d { 5, 4, 14 }, Pos3d { 6, 6, 16 }, Pos3d { 3, 7, 9 } }) {
+            std::unique_ptr<Game> game = buildGame(0, dims);
+            REQUIRE( game->getDimensions().x == dims.x );
+            REQUIRE( game->getDimensions().y == dims.y );
+            REQUIRE( game->getDimensions().z == dims.z );
+            while (!game->isOver()) game->drop();
+        }
+    }
+
+    SECTION("supported dimensions") {
+        // buildGame and the constructors abort on the others
+        REQUIRE( GameState::isSupported(Pos3d { 8, 8, 16 }) );
+        REQUIRE( GameState::isSupported(Pos3d { 32, 2, 16 }) );
+        REQUIRE( GameState::isSupported(Pos3d { 4, 4, GameState::MAX_HEIGHT }) );
+        REQUIRE( !GameState::isSupported(Pos3d { 9, 8, 10 }) );
+        REQUIRE( !GameState::isSupported(Pos3d { 4, 4, GameState::MAX_HEIGHT + 1 }) );
+        REQUIRE( !GameState::isSupported(Pos3d { 8, 8, 17 }) );
+        REQUIRE( !GameState::isSupported(Pos3d { 0, 4, 14 }) );
+        REQUIRE( !GameState::isSupported(Pos3d { 1 << 20, 1 << 20, 1 }) );
+
+        // the first piece of these seeds is longer than the board is deep
+        for (unsigned int seed : { 4, 7, 9, 20 }) {
+            std::unique_ptr<Game> game = buildGame(seed, Pos3d { 32, 2, 16 });
+            REQUIRE( game->isOver() );
+            game->tick(5000);
+            game->drop();
+            REQUIRE( game->getAllBlocks().empty() );
+        }
+    }
+
+    SECTION("snapshot and restore") {
+        static_assert(std::is_trivially_copyable<GameState>::value,
+            "GameState should be trivially copyable");
+
+        auto play = [](Game &game, int nSteps) {
+            for (int i = 0; i < nSteps && !game.isOver(); ++i) {
+                game.moveXY(i % 3 == 0 ? -1 : 0, i % 3 == 0 ? 0 : 1);
+                game.rotate(Axis::X, RotationDirection::CCW);
+                if (i % 4 == 0) game.drop();
+                else game.tick(700);
+            }
+        };
+        auto sameBlocks = [](const Game &a, const Game &b) {
+            const auto ba = a.getAllBlocks(), bb = b.getAllBlocks();
+            if (ba.size() != bb.size()) return false;
+            for (std::size_t i = 0; i < ba.size(); ++i) {
+                if (ba[i].pos.x != bb[i].pos.x || ba[i].pos.y != bb[i].pos.y ||
+                    ba[i].pos.z != bb[i].pos.z || ba[i].pieceId != bb[i].pieceId)
+                    return false;
+            }
+            return a.getScore() == b.getScore() && a.isOver() == b.isOver();
+        };
+
+        std::unique_ptr<GameState> state(new GameState);
+        ConcreteGame game(7), reference(7);
+        ConcreteGame other(123);
+        play(game, 20);
+        play(reference, 20);
+        game.snapshot(*state);
+
+        play(reference, 30);
+        play(game, 30);
+        REQUIRE( sameBlocks(game, reference) );
+
+        // restoring does not allocate
+        const std::size_t before = nAllocations;
+        game.restore(*state);
+        other.restore(*state);
+        REQUIRE( nAllocations == before );
+
+        std::vector<CementedChange> changes;
+        REQUIRE( !game.getCementedChangesSince(0, changes) );
+        REQUIRE( game.getCementedChangesSince(game.getCementedVersion(), changes) );
+
+        play(game, 30);
+        play(other, 30);
+        REQUIRE( sameBlocks(game, reference) );
+        REQUIRE( sameBlocks(other, reference) );
+    }
+
+    SECTION("golden piece sequence") {
+        // also checked in browser/test/game-cpp.js for the Emscripten build
+        ConcreteGame game(2024);
+        int nPieces = 0;
+        uint64_t checksum = 0;
+        while (!game.isOver()) {
+            for (Block b : game.getActiveBlocks()) {
+                checksum = (checksum*31 + b.pos.x + 8*b.pos.y + 64*b.pos.z) % 1000000007;
+            }
+            game.moveXY(nPieces % 2 ? 1 : -1, 0);
+            game.moveXY(0, nPieces % 3 ? 1 : -1);
+            game.rotate(Axis::Y, RotationDirection::CW);
+            game.drop();
+            nPieces++;
+        }
+        REQUIRE( nPieces == 21 );
+        REQUIRE( game.getScore() == 131 );
+        REQUIRE( checksum == 755300241 );
+    }
+
+    SECTION("moves should not allocate") {
+        ConcreteGame game(0);
+
+        int nDrops = 0;
+        std::size_t nMoveAllocations = 0;
+        while (!game.isOver()) {
+            const std::size_t before = nAllocations;
+            game.moveXY(nDrops % 2 == 0 ? 1 : -1, 0);
+            game.moveXY(0, nDrops % 3 == 0 ? 1 : -1);
+            game.rotate(static_cast<Axis>(nDrops % 3), RotationDirection::CW);
+            game.rotate(Axis::Z, RotationDirection::CCW);
+            // gravity moves the piece and, every few pieces, locks it
+            game.tick(nDrops % 4 == 0 ? 15000 : 1500);
+            if (!game.isOver()) game.drop();
+            nMoveAllocations += nAllocations - before;
+            nDrops++;
+        }
+        REQUIRE( nDrops > 2 );
+        REQUIRE( nMoveAllocations == 0 );
+    }
+}
+
+TEST_CASE( "GameBatch", "[game-batch]" ) {
+    typedef GameBatch::Action Action;
+
+    auto sameState = [](const GameState &a, const GameState &b) {
+        const Pos3d d = a.dimensions;
+        if (d.x != b.dimensions.x || d.y != b.dimensions.y || d.z != b.dimensions.z) return false;
+        for (int z = 0; z < d.z; ++z) if (a.layers[z] != b.layers[z]) return false;
+        for (int i = 0; i < d.x*d.y*d.z; ++i) if (a.pieceIds[i] != b.pieceIds[i]) return false;
+        for (int i = 0; i < 4; ++i) if (a.randomState[i] != b.randomState[i]) return false;
+        return a.activeShape == b.activeShape &&
+            a.activeCenter.x == b.activeCenter.x &&
+            a.activeCenter.y == b.activeCenter.y &&
+            a.activeCenter.z == b.activeCenter.z &&
+            a.activePieceId == b.activePieceId &&
+            a.score == b.score && a.alive == b.alive &&
+            a.timeMs == b.timeMs && a.timeToNextDownMs == b.timeToNextDownMs &&
+            a.nDroppedPieces == b.nDroppedPieces && a.nextPieceId == b.nextPieceId;
+    };
+
+    auto applyToGame = [](Game &game, Action action) {
+        switch (action) {
+        case Action::NONE: break;
+        case Action::MOVE_X_POS: game.moveXY(1, 0); break;
+        case Action::MOVE_X_NEG: game.moveXY(-1, 0); break;
+        case Action::MOVE_Y_POS: game.moveXY(0, 1); break;
+        case Action::MOVE_Y_NEG: game.moveXY(0, -1); break;
+        case Action::DROP: game.drop(); break;
+        default: {
+            const int rotation = static_cast<int>(action) - static_cast<int>(Action::ROTATE_X_CW);
+            game.rotate(static_cast<Axis>(rotation / 2),
+                rotation % 2 == 0 ? RotationDirection::CW : RotationDirection::CCW);
+        }
+        }
+    };
+
+    SECTION("same as ConcreteGame") {
+        const Pos3d dims { 4, 4, 10 };
+        const int N = 64;
+        std::vector<unsigned int> seeds;
+        std::vector< std::unique_ptr<ConcreteGame> > games;
+        for (int i = 0; i < N; ++i) {
+            seeds.push_back(100 + i);
+            games.emplace_back(new ConcreteGame(100 + i, dims));
+        }
+        GameBatch batch(seeds, dims);
+        REQUIRE( batch.size() == N );
+        REQUIRE( batch.countAlive() == N );
+
+        std::unique_ptr<GameState> expected(new GameState), actual(new GameState);
+        std::mt19937 rng(1);
+
+        // a full bottom layer, removed when the first piece lands, and
+        // nearly full ones that random play may complete
+        for (int i = 0; i < N; ++i) {
+            games[i]->snapshot(*expected);
+            expected->layers[0] = 0xffff;
+            for (int z = 1; z < 3; ++z) expected->layers[z] = 0xffff & ~(1u << (rng() % 16));
+            games[i]->restore(*expected);
+            batch.restore(i, *expected);
+        }
+        std::vector<Action> actions(N);
+        std::vector<unsigned int> versions;
+        for (const auto &game : games) versions.push_back(game->getCementedVersion());
+        std::vector<CementedChange> changes;
+        bool anyRemoved = false;
+        for (int step = 0; step < 400 && batch.countAlive() > 0; ++step) {
+            for (Action &a : actions) a = static_cast<Action>(rng() % 12);
+            // mostly short frames, sometimes several drop intervals at once
+            const int dt = step % 50 == 49 ? 3500 : static_cast<int>(rng() % 300);
+            batch.step(actions, dt);
+
+            for (int i = 0; i < N; ++i) {
+                applyToGame(*games[i], actions[i]);
+                games[i]->tick(dt);
+                games[i]->snapshot(*expected);
+                batch.snapshot(i, *actual);
+                REQUIRE( sameState(*expected, *actual) );
+                REQUIRE( batch.isOver(i) == games[i]->isOver() );
+                REQUIRE( batch.getScore(i) == games[i]->getScore() );
+
+                changes.clear();
+                games[i]->getCementedChangesSince(versions[i], changes);
+                versions[i] = games[i]->getCementedVersion();
+                for (const CementedChange &c : changes)
+                    if (c.type == ChangeType::LAYER_REMOVED) anyRemoved = true;
+            }
+        }
+        REQUIRE( anyRemoved );
+        REQUIRE( batch.countAlive() == 0 );
+    }
+
+    SECTION("long ticks") {
+        // gravity runs until the games end, in one tick
+        const Pos3d dims { 5, 4, 14 };
+        GameBatch batch({ 4, 5, 6 }, dims);
+        batch.tick(std::numeric_limits<int>::max() / 2);
+        REQUIRE( batch.countAlive() == 0 );
+
+        std::unique_ptr<GameState> expected(new GameState), actual(new GameState);
+        for (int i = 0; i < batch.size(); ++i) {
+            ConcreteGame game(4 + i, dims);
+            game.tick(std::numeric_limits<int>::max() / 2);
+            game.snapshot(*expected);
+            batch.snapshot(i, *actual);
+            REQUIRE( sameState(*expected, *actual) );
+        }
+    }
+
+    SECTION("largest supported dimensions") {
+        // full 64-bit layers and the most layers; the constructor aborts
+        // on unsupported dimensions like buildGame
+        for (Pos3d dims : { Pos3d { 64, 1, 16 }, Pos3d { 8, 8, 16 }, Pos3d { 32, 1, GameState::MAX_HEIGHT } }) {
+            REQUIRE( GameState::isSupported(dims) );
+            GameBatch batch({ 0, 1, 2 }, dims);
+            batch.tick(std::numeric_limits<int>::max() / 2);
+
+            std::unique_ptr<GameState> expected(new GameState), actual(new GameState);
+            for (int i = 0; i < batch.size(); ++i) {
+                ConcreteGame game(i, dims);
+                game.tick(std::numeric_limits<int>::max() / 2);
+                game.snapshot(*expected);
+                batch.snapshot(i, *actual);
+                REQUIRE( sameState(*expected, *actual) );
+            }
+        }
+    }
+
+    SECTION("layers and restore") {
+        GameBatch batch({ 1, 2 }, Pos3d { 5, 4, 14 });
+        std::vector<Action> actions { Action::DROP, Action::NONE };
+        batch.step(actions, 10);
+        REQUIRE( batch.getLayers(0)[0] != 0 );
+        REQUIRE( batch.getLayers(0)[1] == 0 );
+        REQUIRE( batch.getTimeMs(1) == 10 );
+
+        // restart the first game from a fresh one
+        std::unique_ptr<GameState> state(new GameState);
+        ConcreteGame fresh(5);
+        fresh.snapshot(*state);
+        batch.restore(0, *state);
+        REQUIRE( batch.getLayers(0)[0] == 0 );
+        REQUIRE( batch.getScore(0) == 0 );
+        REQUIRE( batch.getTimeMs(0) == 0 );
+
+        batch.step(actions, 10);
+        fresh.drop();
+        fresh.tick(10);
+        std::unique_ptr<GameState> actual(new GameState);
+        fresh.snapshot(*state);
+        batch.snapshot(0, *actual);
+        REQUIRE( sameState(*state, *actual) );
+    }
+}
+
+TEST_CASE( "PlacementGenerator", "[placement-generator]" ) {
+    const Pos3d dims { 5, 4, 14 };
+    PlacementGenerator generator(dims);
+    std::unique_ptr<GameState> state(new GameState);
+
+    auto placementCells = [](const Placement &p) {
+        std::vector<int> cells;
+        for (const Block &b : Piece(p.center, p.shape, 0).getBlocks())
+            cells.push_back((b.pos.z*4 + b.pos.y)*5 + b.pos.x);
+        std::sort(cells.begin(), cells.end());
+        return cells;
+    };
+
+    // apply the inputs to a copy of the game and check the cemented cells
+    auto reachesPlacement = [&placementCells](const GameState &state, const Placement &p,
+        const std::vector<PlacementInput> &inputs)
+    {
+        ConcreteGame game(0);
+        game.restore(state);
+        const unsigned int version = game.getCementedVersion();
+        for (PlacementInput input : inputs) placements::applyInput(game, input);
+
+        std::vector<CementedChange> changes;
+        if (!game.getCementedChangesSince(version, changes)) return false;
+        std::vector<int> cells;
+        for (const CementedChange &c : changes) {
+            if (c.type == ChangeType::BLOCK_SET)
+                cells.push_back((c.block.pos.z*4 + c.block.pos.y)*5 + c.block.pos.x);
+        }
+        std::sort(cells.begin(), cells.end());
+        return cells == placementCells(p);
+    };
+
+    SECTION("empty board") {
+        for (unsigned int seed = 0; seed < 20; ++seed) {
+            ConcreteGame game(seed);
+            game.snapshot(*state);
+            const auto &found = generator.generate(*state);
+
+            // every resting pose on the floor is reachable on an empty board
+            std::set< std::vector<int> > expected, actual;
+            const auto &table = piece_shapes::TABLE;
+            const int proto = table.orientations[state->activeShape].prototype;
+            for (int shape = table.first[proto]; shape < table.first[proto] + table.count[proto]; ++shape) {
+                const auto &o = table.orientations[shape];
+                for (int y = -o.min.y; y + o.max.y < dims.y; ++y)
+                    for (int x = -o.min.x; x + o.max.x < dims.x; ++x)
+                        expected.insert(placementCells(Placement { shape, Pos3d { x, y, -o.min.z } }));
+            }
+            for (const Placement &p : found) actual.insert(placementCells(p));
+            REQUIRE( actual.size() == found.size() );
+            REQUIRE( actual == expected );
+        }
+    }
+
+    SECTION("random boards") {
+        std::mt19937 rng(3);
+        std::vector<PlacementInput> inputs;
+        int nChecked = 0;
+        for (unsigned int seed = 0; seed < 10; ++seed) {
+            ConcreteGame game(seed);
+            for (int i = 0; i < 8 && !game.isOver(); ++i) {
+                game.snapshot(*state);
+                const auto &found = generator.generate(*state);
+                REQUIRE( !found.empty() );
+                REQUIRE( generator.getNodeCount() >= static_cast<int>(found.size()) );
+
+                for (const Placement &p : found) {
+                    inputs.clear();
+                    generator.getInputs(p, inputs);
+                    REQUIRE( inputs.back() == PlacementInput::DROP );
+                    REQUIRE( reachesPlacement(*state, p, inputs) );
+                    nChecked++;
+                }
+
+                // continue the game from a random placement, place gives
+                // the same layers as the game
+                const Placement &p = found[rng() % found.size()];
+                std::vector<uint64_t> expected(state->layers, state->layers + dims.z);
+                generator.place(p, expected.data());
+                inputs.clear();
+                generator.getInputs(p, inputs);
+                for (PlacementInput input : inputs) placements::applyInput(game, input);
+                game.snapshot(*state);
+                REQUIRE( std::vector<uint64_t>(state->layers, state->layers + dims.z) == expected );
+            }
+        }
+        REQUIRE( nChecked > 1000 );
+    }
+
+    SECTION("game over") {
+        ConcreteGame game(1);
+        while (!game.isOver()) game.drop();
+        game.snapshot(*state);
+        REQUIRE( generator.generate(*state).empty() );
+    }
+
+    SECTION("wide boards") {
+        // block offsets y*dims.x + x reach past 64 bits on these and a row
+        // of a 64x1 board is the whole layer
+        for (Pos3d wide : { Pos3d { 32, 2, 16 }, Pos3d { 64, 1, 16 } }) {
+            PlacementGenerator wideGenerator(wide);
+            std::vector<PlacementInput> inputs;
+            std::mt19937 rng(5);
+            int nPlaced = 0;
+            for (unsigned int seed = 0; seed < 40; ++seed) {
+                ConcreteGame game(seed, wide);
+                for (int i = 0; i < 20 && !game.isOver(); ++i) {
+                    game.snapshot(*state);
+                    const auto &found = wideGenerator.generate(*state);
+                    REQUIRE( !found.empty() );
+
+                    const Placement &p = found[rng() % found.size()];
+                    std::vector<uint64_t> expected(state->layers, state->layers + wide.z);
+                    wideGenerator.place(p, expected.data());
+                    inputs.clear();
+                    wideGenerator.getInputs(p, inputs);
+                    for (PlacementInput input : inputs) placements::applyInput(game, input);
+                    game.snapshot(*state);
+                    REQUIRE( std::vector<uint64_t>(state->layers, state->layers + wide.z) == expected );
+                    nPlaced++;
+                }
+            }
+            // most pieces do not fit a single row, so those games are short
+            REQUIRE( nPlaced >= 10 );
+        }
+    }
+}
+
+TEST_CASE( "BoardFeatures", "[board-features]" ) {
+    // straightforward per-cell version of the features
+    auto reference = [](const std::vector<uint64_t> &layers, Pos3d d) {
+        auto has = [&](int x, int y, int z) { return ((layers[z] >> (y*d.x + x)) & 1) != 0; };
+        std::vector<int> h(d.x*d.y, 0);
+        BoardFeatures f {};
+        for (int y = 0; y < d.y; ++y) {
+            for (int x = 0; x < d.x; ++x) {
+                for (int z = 0; z < d.z; ++z) {
+                    if (has(x, y, z)) { h[y*d.x + x] = z + 1; f.nBlocks++; }
+                }
+                for (int z = 0; z < h[y*d.x + x]; ++z) if (!has(x, y, z)) f.holes++;
+            }
+        }
+        auto height = [&](int x, int y) {
+            return x < 0 || y < 0 || x >= d.x || y >= d.y ? d.z : h[y*d.x + x];
+        };
+        for (int y = 0; y < d.y; ++y) {
+            for (int x = 0; x < d.x; ++x) {
+                const int c = height(x, y);
+                f.aggregateHeight += c;
+                f.maxHeight = std::max(f.maxHeight, c);
+                if (x + 1 < d.x) f.bumpiness += std::abs(c - height(x + 1, y));
+                if (y + 1 < d.y) f.bumpiness += std::abs(c - height(x, y + 1));
+                const int lowest = std::min(std::min(height(x - 1, y), height(x + 1, y)),
+                    std::min(height(x, y - 1), height(x, y + 1)));
+                f.wellDepth += std::max(0, lowest - c);
+                f.maxWellDepth = std::max(f.maxWellDepth, std::max(0, lowest - c));
+            }
+        }
+        for (int z = 0; z < d.z; ++z) {
+            int nEmpty = 0;
+            for (int y = 0; y < d.y; ++y)
+                for (int x = 0; x < d.x; ++x) nEmpty += !has(x, y, z);
+            f.fullLayers += nEmpty == 0;
+            f.nearFullLayers += nEmpty == 1 || nEmpty == 2;
+        }
+        return f;
+    };
+
+    auto same = [](const BoardFeatures &a, const BoardFeatures &b) {
+        return a.nBlocks == b.nBlocks && a.holes == b.holes &&
+            a.aggregateHeight == b.aggregateHeight && a.maxHeight == b.maxHeight &&
+            a.bumpiness == b.bumpiness && a.wellDepth == b.wellDepth &&
+            a.maxWellDepth == b.maxWellDepth && a.fullLayers == b.fullLayers &&
+            a.nearFullLayers == b.nearFullLayers;
+    };
+
+    std::vector<BoardFeatureExtractor::Simd> levels { BoardFeatureExtractor::Simd::SCALAR };
+    if (BoardFeatureExtractor::bestSimd() != BoardFeatureExtractor::Simd::SCALAR) {
+        levels.push_back(BoardFeatureExtractor::Simd::SSE41);
+    }
+    if (BoardFeatureExtractor::bestSimd() == BoardFeatureExtractor::Simd::AVX2) {
+        levels.push_back(BoardFeatureExtractor::Simd::AVX2);
+    }
+
+    SECTION("simple board") {
+        // 3x2x4: a full bottom layer and a tower with a hole at (0, 0)
+        const std::vector<uint64_t> layers { 0x3f, 0x0, 0x1, 0x0 };
+        const BoardFeatures f = BoardFeatureExtractor(Pos3d { 3, 2, 4 }).compute(layers.data());
+        REQUIRE( f.nBlocks == 7 );
+        REQUIRE( f.holes == 1 );
+        REQUIRE( f.maxHeight == 3 );
+        REQUIRE( f.aggregateHeight == 3 + 5 );
+        REQUIRE( f.bumpiness == 4 );
+        REQUIRE( f.fullLayers == 1 );
+        REQUIRE( f.nearFullLayers == 0 );
+        REQUIRE( same(f, reference(layers, Pos3d { 3, 2, 4 })) );
+    }
+
+    SECTION("random boards") {
+        std::mt19937 rng(5);
+        const std::vector<Pos3d> sizes {
+            Pos3d { 5, 4, 14 }, Pos3d { 1, 1, 3 }, Pos3d { 7, 3, 10 }, Pos3d { 8, 8, 20 }, Pos3d { 64, 1, 5 }
+        };
+        for (Pos3d d : sizes) {
+            const uint64_t full = d.x*d.y == 64 ? ~uint64_t(0) : (uint64_t(1) << (d.x*d.y)) - 1;
+            const int N = 50;
+            std::vector<uint64_t> layers(N*d.z);
+            for (int b = 0; b < N; ++b) {
+                // denser at the bottom, some full and nearly full layers
+                for (int z = 0; z < d.z; ++z) {
+                    uint64_t layer = (uint64_t(rng()) << 32 | rng()) & full;
+                    if (z > b % d.z) layer &= (uint64_t(rng()) << 32 | rng());
+                    if (rng() % 5 == 0) layer = full & ~(uint64_t(1) << (rng() % (d.x*d.y)));
+                    if (rng() % 7 == 0) layer = full;
+                    layers[b*d.z + z] = layer;
+                }
+            }
+
+            for (auto simd : levels) {
+                std::vector<BoardFeatures> out(N);
+                BoardFeatureExtractor extractor(d, simd);
+                REQUIRE( extractor.getSimd() == simd );
+                extractor.computeBatch(layers.data(), N, out.data());
+                for (int b = 0; b < N; ++b) {
+                    const std::vector<uint64_t> board(&layers[b*d.z], &layers[(b + 1)*d.z]);
+                    REQUIRE( same(out[b], reference(board, d)) );
+                }
+            }
+        }
+    }
+
+    SECTION("weights by index") {
+        FeatureWeights w;
+        const FeatureWeights &constW = w;
+        REQUIRE( constW[0] == w.holes );
+        REQUIRE( constW[3] == w.bumpiness );
+        REQUIRE( constW[FeatureWeights::N_WEIGHTS - 1] == w.removedLayers );
+        for (int i = 0; i < FeatureWeights::N_WEIGHTS; ++i) w[i] = i;
+        REQUIRE( w.holes == 0 );
+        REQUIRE( w.aggregateHeight == 1 );
+        REQUIRE( w.maxWellDepth == 5 );
+        REQUIRE( w.removedLayers == 7 );
+    }
+}
+
+TEST_CASE( "Autoplayer", "[autoplayer]" ) {
+    const Pos3d dims { 5, 4, 14 };
+    std::unique_ptr<GameState> state(new GameState);
+
+    SECTION("plays long games") {
+        WorkStealingPool pool(2);
+        Autoplayer player(dims, pool, 4, 1);
+        for (unsigned int seed = 0; seed < 2; ++seed) {
+            ConcreteGame game(seed);
+            for (int i = 0; i < 150; ++i) {
+                game.snapshot(*state);
+                const int nDropped = state->nDroppedPieces;
+                REQUIRE( player.play(game) );
+                REQUIRE( player.getLastDepth() == 2 );
+                game.snapshot(*state);
+                // each play places exactly the active piece
+                REQUIRE( state->nDroppedPieces == nDropped + 1 );
+            }
+            REQUIRE( !game.isOver() );
+            // 600 blocks do not fit in 280 cells without removing at
+            // least 16 layers
+            REQUIRE( game.getScore() >= 16 * game_config::REMOVAL_SCORE_MULTIPLIER );
+        }
+    }
+
+    SECTION("same moves with any number of threads") {
+        WorkStealingPool pool1(1), pool4(4);
+        Autoplayer player1(dims, pool1, 6, 2), player4(dims, pool4, 6, 2);
+        ConcreteGame game1(7), game4(7);
+        std::unique_ptr<GameState> other(new GameState);
+        for (int i = 0; i < 20; ++i) {
+            player1.play(game1);
+            player4.play(game4);
+            game1.snapshot(*state);
+            game4.snapshot(*other);
+            REQUIRE( std::equal(state->layers, state->layers + dims.z, other->layers) );
+            REQUIRE( state->score == other->score );
+        }
+    }
+
+    SECTION("threads outside the pool search at once") {
+        // each waits only for its own tasks and uses its own scratch
+        WorkStealingPool pool(2);
+        Autoplayer player1(dims, pool, 8, 1), player2(dims, pool, 8, 1);
+        ConcreteGame game1(5), game2(5);
+        std::thread other([&player2, &game2]() {
+            for (int i = 0; i < 30; ++i) player2.play(game2);
+        });
+        for (int i = 0; i < 30; ++i) player1.play(game1);
+        other.join();
+        game1.snapshot(*state);
+        std::unique_ptr<GameState> state2(new GameState);
+        game2.snapshot(*state2);
+        REQUIRE( std::equal(state->layers, state->layers + dims.z, state2->layers) );
+        REQUIRE( state->score == state2->score );
+    }
+
+    SECTION("time budget") {
+        WorkStealingPool pool(2);
+        Autoplayer player(dims, pool, 1000, 20);
+        ConcreteGame game(3);
+        game.snapshot(*state);
+        std::vector<PlacementInput> inputs;
+        REQUIRE( player.chooseInputs(*state, 5, inputs) );
+        REQUIRE( inputs.back() == PlacementInput::DROP );
+        // a beam this wide does not reach depth 21 in 5 ms
+        REQUIRE( player.getLastDepth() >= 1 );
+        REQUIRE( player.getLastDepth() < 21 );
+    }
+
+    SECTION("game over") {
+        WorkStealingPool pool(1);
+        Autoplayer player(dims, pool);
+        ConcreteGame game(1);
+        while (!game.isOver()) game.drop();
+        REQUIRE( !player.play(game) );
+    }
+}
+
+TEST_CASE( "ExpectimaxSearch", "[expectimax]" ) {
+    std::unique_ptr<GameState> state(new GameState);
+
+    SECTION("same as plain expectimax") {
+        // depth 1 without candidate limits, memo or deduplication
+        const Pos3d dims { 4, 3, 10 };
+        const GameBox box(dims);
+        const FeatureWeights weights;
+        PlacementGenerator rootGenerator(dims), generator(dims);
+        BoardFeatureExtractor extractor(dims);
+        std::unique_ptr<GameState> child(new GameState);
+        const int N = piece_shapes::N_PROTOTYPES;
+
+        auto bestStatic = [&](const uint64_t *board, int proto) {
+            const int shape = piece_shapes::TABLE.first[proto];
+            child->dimensions = dims;
+            std::copy(board, board + dims.z, child->layers);
+            child->activeShape = shape;
+            child->activeCenter = box.translateToBounds(shape, Pos3d { 2, 1, 15 });
+            child->alive = true;
+            double best = -1e6;
+            bool first = true;
+            for (const Placement &p : generator.generate(*child)) {
+                std::vector<uint64_t> layers(board, board + dims.z);
+                const int nRemoved = generator.place(p, layers.data());
+                const double v = evaluate(extractor.compute(layers.data()), nRemoved, weights);
+                if (first || v > best) best = v;
+                first = false;
+            }
+            return best;
+        };
+
+        WorkStealingPool pool(3);
+        ExpectimaxSearch search(dims, pool, 1, 1000);
+        for (unsigned int seed = 0; seed < 3; ++seed) {
+            ConcreteGame game(seed, dims);
+            for (int i = 0; i < 2; ++i) game.drop();
+            game.snapshot(*state);
+            REQUIRE( state->alive );
+
+            double expected = 0;
+            bool first = true;
+            for (const Placement &p : rootGenerator.generate(*state)) {
+                std::vector<uint64_t> layers(state->layers, state->layers + dims.z);
+                const int nRemoved = rootGenerator.place(p, layers.data());
+                double v = weights.removedLayers*nRemoved;
+                for (int proto = 0; proto < N; ++proto) v += bestStatic(layers.data(), proto) / N;
+                if (first || v > expected) expected = v;
+                first = false;
+            }
+
+            const ExpectimaxSearch::Result result = search.search(*state);
+            REQUIRE( result.found );
+            REQUIRE( result.value == Approx(expected) );
+            REQUIRE( result.nNodes > 0 );
+            REQUIRE( result.nEvaluations > 0 );
+        }
+    }
+
+    SECTION("same result with any number of threads") {
+        const Pos3d dims { 5, 4, 14 };
+        WorkStealingPool pool1(1), pool4(4);
+        ExpectimaxSearch search1(dims, pool1, 2, 4), search4(dims, pool4, 2, 4);
+        ConcreteGame game(11);
+        for (int i = 0; i < 5; ++i) game.drop();
+        game.snapshot(*state);
+
+        const auto a = search1.search(*state), b = search4.search(*state);
+        REQUIRE( a.value == b.value );
+        REQUIRE( a.expectedScore == b.expectedScore );
+        REQUIRE( a.placement.shape == b.placement.shape );
+        REQUIRE( a.placement.center.x == b.placement.center.x );
+        REQUIRE( a.placement.center.y == b.placement.center.y );
+        REQUIRE( a.placement.center.z == b.placement.center.z );
+        // the same boards are reached after different placements
+        REQUIRE( a.nMemoHits > 0 );
+    }
+
+    SECTION("plays") {
+        const Pos3d dims { 5, 4, 14 };
+        WorkStealingPool pool(2);
+        ExpectimaxSearch search(dims, pool, 1, 4);
+        ConcreteGame game(4);
+        for (int i = 0; i < 60; ++i) REQUIRE( search.play(game) );
+        REQUIRE( game.getScore() > 0 );
+        while (!game.isOver()) game.drop();
+        REQUIRE( !search.play(game) );
+    }
+}
+
+TEST_CASE( "Arena", "[arena]" ) {
+    Arena arena(64);
+    char *c = arena.create<char>('a');
+    double *d = arena.create<double>(1.5);
+    REQUIRE( *c == 'a' );
+    REQUIRE( *d == 1.5 );
+    REQUIRE( reinterpret_cast<std::uintptr_t>(d) % alignof(double) == 0 );
+
+    // larger than a chunk
+    int *array = arena.createArray<int>(100);
+    for (int i = 0; i < 100; ++i) REQUIRE( array[i] == 0 );
+    REQUIRE( arena.getUsedBytes() >= sizeof(char) + sizeof(double) + 100*sizeof(int) );
+
+    // the memory is reused after a reset
+    arena.reset();
+    REQUIRE( arena.getUsedBytes() == 0 );
+    REQUIRE( arena.create<char>('b') == c );
+}
+
+TEST_CASE( "MctsSearch", "[mcts]" ) {
+    std::unique_ptr<GameState> state(new GameState);
+    const Pos3d dims { 5, 4, 14 };
+
+    SECTION("runs the given number of playouts") {
+        WorkStealingPool pool(4);
+        MctsSearch search(dims, pool);
+        ConcreteGame game(3);
+        for (int i = 0; i < 4; ++i) game.drop();
+        game.snapshot(*state);
+
+        for (long n : { 1L, 10L, 500L }) {
+            const MctsSearch::Result result = search.search(*state, n);
+            REQUIRE( result.found );
+            REQUIRE( result.nPlayouts == n );
+            // no virtual losses left
+            REQUIRE( result.visits >= 1 );
+            REQUIRE( result.visits <= n );
+            REQUIRE( result.value >= 0 );
+            REQUIRE( search.getTreeBytes() > 0 );
+        }
+
+        // the time budget stops the search
+        const MctsSearch::Result timed = search.search(*state, 1L << 40, 20);
+        REQUIRE( timed.found );
+        REQUIRE( timed.nPlayouts > 0 );
+        REQUIRE( timed.seconds < 2.0 );
+    }
+
+    SECTION("plays") {
+        WorkStealingPool pool(2);
+        MctsSearch search(dims, pool);
+        ConcreteGame game(8);
+        for (int i = 0; i < 20; ++i) REQUIRE( search.play(game, 200) );
+        game.snapshot(*state);
+        REQUIRE( state->nDroppedPieces == 20 );
+        while (!game.isOver()) game.drop();
+        REQUIRE( !search.play(game, 200) );
+    }
+}
+
+TEST_CASE( "Zobrist", "[zobrist]" ) {
+    std::unique_ptr<GameState> state(new GameState);
+
+    SECTION("block array keys") {
+        const Pos3d dims { 3, 2, 5 };
+        GameBox box(dims);
+        CementedBlockArray blocks(box);
+        REQUIRE( blocks.getZobristKey() == 0 );
+
+        auto expectedKey = [&]() {
+            blocks.saveTo(*state);
+            return zobrist::boardKey(state->layers, dims);
+        };
+
+        blocks.setBlock(Block{Pos3d { 1, 1, 0 }, 1});
+        const uint64_t oneBlock = blocks.getZobristKey();
+        REQUIRE( oneBlock == zobrist::cellKey(1*3 + 1) );
+        // setting again does not change the key
+        blocks.setBlock(Block{Pos3d { 1, 1, 0 }, 2});
+        REQUIRE( blocks.getZobristKey() == oneBlock );
+
+        for (int x = 0; x < 3; ++x)
+            for (int y = 0; y < 2; ++y) blocks.setBlock(Block{Pos3d { x, y, 2 }, 3});
+        blocks.setBlock(Block{Pos3d { 0, 1, 3 }, 4});
+        blocks.setBlock(Block{Pos3d { 2, 0, 4 }, 4});
+        REQUIRE( blocks.getZobristKey() == expectedKey() );
+
+        blocks.removeLayer(2);
+        REQUIRE( blocks.getZobristKey() == expectedKey() );
+        blocks.removeLayer(0);
+        REQUIRE( blocks.getZobristKey() == expectedKey() );
+
+        for (int x = 0; x < 3; ++x)
+            for (int y = 0; y < 2; ++y) blocks.setBlock(Block{Pos3d { x, y, 0 }, 5});
+        blocks.setBlock(Block{Pos3d { 1, 0, 3 }, 6});
+        REQUIRE( blocks.removeFullLayers() == 1 );
+        REQUIRE( blocks.getZobristKey() == expectedKey() );
+
+        // restored arrays get the key of their contents
+        CementedBlockArray restored(box);
+        restored.restoreFrom(*state);
+        REQUIRE( restored.getZobristKey() == blocks.getZobristKey() );
+    }
+
+    SECTION("game keys") {
+        ConcreteGame game(9, Pos3d { 5, 4, 14 });
+        std::mt19937 rng(9);
+        std::set<uint64_t> keys;
+        for (int i = 0; i < 2000 && !game.isOver(); ++i) {
+            switch (rng() % 6) {
+            case 0: game.moveXY(1, 0); break;
+            case 1: game.moveXY(-1, 0); break;
+            case 2: game.moveXY(0, 1); break;
+            case 3: game.rotate(Axis::Z, RotationDirection::CW); break;
+            case 4: game.rotate(Axis::Y, RotationDirection::CCW); break;
+            default:
+                game.tick(1000);
+                if (i % 3 == 0) game.drop();
+                break;
+            }
+            game.snapshot(*state);
+            REQUIRE( game.getZobristKey() == zobrist::stateKey(*state) );
+            keys.insert(game.getZobristKey());
+        }
+        REQUIRE( keys.size() > 100 );
+
+        game.snapshot(*state);
+        ConcreteGame restored(0, Pos3d { 5, 4, 14 });
+        restored.restore(*state);
+        REQUIRE( restored.getZobristKey() == game.getZobristKey() );
+    }
+}
+
+TEST_CASE( "TranspositionTable", "[transposition-table]" ) {
+    struct Value {
+        uint64_t a, b;
+    };
+
+    SECTION("find and store") {
+        TranspositionTable<Value> table(100);
+        REQUIRE( table.getEntryCount() == 128 );
+        Value v { 0, 0 };
+        REQUIRE( !table.find(42, v) );
+        // key zero is a valid key, not an empty entry
+        REQUIRE( !table.find(0, v) );
+
+        table.store(42, Value { 1, 2 });
+        table.store(0, Value { 3, 4 });
+        REQUIRE( table.find(42, v) );
+        REQUIRE( v.a == 1 );
+        REQUIRE( v.b == 2 );
+        REQUIRE( table.find(0, v) );
+        REQUIRE( v.a == 3 );
+
+        // replaced by a store of the same key
+        table.store(42, Value { 5, 6 });
+        REQUIRE( table.find(42, v) );
+        REQUIRE( v.a == 5 );
+
+        const auto stats = table.getStatistics();
+        REQUIRE( stats.hits == 3 );
+        REQUIRE( stats.misses == 2 );
+        REQUIRE( stats.stores == 3 );
+        REQUIRE( stats.collisions == 0 );
+
+        table.newGeneration();
+        REQUIRE( !table.find(42, v) );
+        table.resetStatistics();
+        REQUIRE( table.getStatistics().misses == 0 );
+    }
+
+    SECTION("replacement") {
+        // one bucket, so all keys collide
+        TranspositionTable<Value> table(TranspositionTable<Value>::BUCKET_SIZE);
+        const int N = TranspositionTable<Value>::BUCKET_SIZE;
+        Value v { 0, 0 };
+        for (int i = 0; i < N; ++i) table.store(i, Value { uint64_t(i), 0 }, 10 + i);
+        REQUIRE( table.getStatistics().collisions == 0 );
+
+        // evicts the lowest priority
+        table.store(100, Value { 100, 0 }, 1);
+        REQUIRE( table.getStatistics().collisions == 1 );
+        REQUIRE( !table.find(0, v) );
+        REQUIRE( table.find(100, v) );
+        for (int i = 1; i < N; ++i) REQUIRE( table.find(i, v) );
+
+        // stale entries go first
+        table.newGeneration();
+        table.store(200, Value { 200, 0 }, 0);
+        REQUIRE( table.getStatistics().collisions == 1 );
+    }
+
+    SECTION("shared by threads") {
+        TranspositionTable<Value> table(1 << 10);
+        WorkStealingPool pool(4);
+        std::atomic<int> nBad(0), nHits(0);
+        {
+            TaskGroup tasks(pool);
+            for (int t = 0; t < 8; ++t) {
+                tasks.run([&, t]() {
+                    Xoshiro128 random(t);
+                    for (int i = 0; i < 20000; ++i) {
+                        const uint64_t key = random.nextBelow(4096);
+                        Value v;
+                        if (table.find(key, v)) {
+                            nHits++;
+                            // never a mix of two stores
+                            if (v.a != key || v.b != ~key) nBad++;
+                        } else {
+                            table.store(key, Value { key, ~key });
+                        }
+                    }
+                });
+            }
+            tasks.wait();
+        }
+        REQUIRE( nBad == 0 );
+        REQUIRE( nHits > 0 );
+        const auto stats = table.getStatistics();
+        REQUIRE( stats.hits + stats.misses == 8*20000 );
+        REQUIRE( stats.collisions > 0 );
+    }
+}
+
+TEST_CASE( "HintService", "[hint-service]" ) {
+    const Pos3d dims { 5, 4, 14 };
+    WorkStealingPool pool(2);
+    HintService hints(dims, pool);
+    HintService::Hint hint;
+
+    SECTION("nothing requested") {
+        ConcreteGame game(1);
+        REQUIRE( !hints.getHint(game, hint) );
+        REQUIRE( !hints.waitForHint(hint, 10) );
+    }
+
+    SECTION("hints place the active piece") {
+        ConcreteGame game(2);
+        for (int i = 0; i < 10; ++i) {
+            hints.request(game, 200);
+            REQUIRE( hints.waitForHint(hint, 10000) );
+            REQUIRE( hint.final );
+            REQUIRE( hint.found );
+            REQUIRE( hint.depth >= 1 );
+            REQUIRE( hint.inputs.back() == PlacementInput::DROP );
+
+            // the game has not changed, the hint stays available
+            HintService::Hint again;
+            REQUIRE( hints.getHint(game, again) );
+            REQUIRE( again.inputs == hint.inputs );
+
+            const unsigned int version = game.getCementedVersion();
+            for (PlacementInput input : hint.inputs) placements::applyInput(game, input);
+            REQUIRE( game.getCementedVersion() != version );
+        }
+        REQUIRE( !game.isOver() );
+    }
+
+    SECTION("cancelled when the game changes") {
+        ConcreteGame game(3);
+        hints.request(game, 200);
+        REQUIRE( hints.waitForHint(hint, 10000) );
+        REQUIRE( hints.getHint(game, hint) );
+
+        game.tick(game_config::DROP_INTERVAL_MS);
+        REQUIRE( !hints.getHint(game, hint) );
+        REQUIRE( !hints.waitForHint(hint, 10) );
+
+        // a new request for the new state
+        hints.request(game, 200);
+        REQUIRE( hints.waitForHint(hint, 10000) );
+        REQUIRE( hints.getHint(game, hint) );
+    }
+
+    SECTION("game over") {
+        ConcreteGame game(4);
+        while (!game.isOver()) game.drop();
+        hints.request(game, 100);
+        REQUIRE( hints.waitForHint(hint, 10000) );
+        REQUIRE( hint.final );
+        REQUIRE( !hint.found );
+    }
+
+    SECTION("requests replace each other") {
+        ConcreteGame game(5);
+        for (int i = 0; i < 20; ++i) {
+            hints.request(game, 1000);
+            game.moveXY(i % 2 ? 1 : -1, 0);
+        }
+        hints.request(game, 50);
+        REQUIRE( hints.waitForHint(hint, 10000) );
+        REQUIRE( hint.seconds < 5.0 );
+    }
+
+    SECTION("overlaps a search of the game thread on the same pool") {
+        Autoplayer foreground(dims, pool, 8, 1);
+        WorkStealingPool otherPool(1);
+        Autoplayer reference(dims, otherPool, 8, 1);
+        ConcreteGame game(6), referenceGame(6), hinted(7);
+        std::unique_ptr<GameState> state(new GameState), referenceState(new GameState);
+
+        for (int i = 0; i < 10; ++i) {
+            hints.request(hinted, 200);
+            // the hint thread searches while this one does
+            for (int j = 0; j < 3; ++j) {
+                REQUIRE( foreground.play(game) );
+                REQUIRE( reference.play(referenceGame) );
+                hints.getHint(hinted, hint);
+            }
+            REQUIRE( hints.waitForHint(hint, 10000) );
+            REQUIRE( hint.found );
+            for (PlacementInput input : hint.inputs) placements::applyInput(hinted, input);
+        }
+        game.snapshot(*state);
+        referenceGame.snapshot(*referenceState);
+        REQUIRE( std::equal(state->layers, state->layers + dims.z, referenceState->layers) );
+        REQUIRE( state->score == referenceState->score );
+        REQUIRE( !hinted.isOver() );
+    }
+}
+
+TEST_CASE( "ValueNetwork", "[value-network]" ) {
+    const Pos3d dims { 5, 4, 7 };
+    const int nInputs = dims.x*dims.y*dims.z + dims.x*dims.y;
+
+    ValueNetwork::Weights w;
+    w.dimensions = dims;
+    w.nHidden1 = 13;
+    w.nHidden2 = 9;
+    std::mt19937 rng(5);
+    std::uniform_int_distribution<int> int8s(-128, 127);
+    std::uniform_real_distribution<float> floats(-1.0f, 1.0f);
+    for (int i = 0; i < w.nHidden1*nInputs; ++i) w.w1.push_back(static_cast<int8_t>(int8s(rng)));
+    for (int i = 0; i < w.nHidden1; ++i) {
+        w.scale1.push_back(0.01f);
+        w.bias1.push_back(floats(rng));
+    }
+    for (int i = 0; i < w.nHidden2*w.nHidden1; ++i) w.w2.push_back(floats(rng));
+    for (int i = 0; i < w.nHidden2; ++i) {
+        w.bias2.push_back(floats(rng));
+        w.w3.push_back(floats(rng));
+    }
+    w.bias3 = 0.5f;
+
+    char path[] = "/tmp/value-network-XXXXXX";
+    const int fd = mkstemp(path);
+    REQUIRE( fd >= 0 );
+    close(fd);
+    REQUIRE( ValueNetwork::write(path, w) );
+
+    // the network computed directly from the definition
+    auto reference = [&](const uint64_t *layers) {
+        std::vector<int> input(nInputs, 0);
+        const int layerSize = dims.x*dims.y;
+        for (int z = 0; z < dims.z; ++z) {
+            for (int c = 0; c < layerSize; ++c) {
+                if ((layers[z] >> c) & 1) {
+                    input[z*layerSize + c] = 1;
+                    input[dims.z*layerSize + c] = z + 1;
+                }
+            }
+        }
+        std::vector<double> h1(w.nHidden1), h2(w.nHidden2);
+        for (int j = 0; j < w.nHidden1; ++j) {
+            long acc = 0;
+            for (int i = 0; i < nInputs; ++i) acc += long(w.w1[j*nInputs + i]) * input[i];
+            h1[j] = std::max(0.0, double(w.scale1[j])*acc + w.bias1[j]);
+        }
+        double value = w.bias3;
+        for (int k = 0; k < w.nHidden2; ++k) {
+            double sum = w.bias2[k];
+            for (int j = 0; j < w.nHidden1; ++j) sum += w.w2[k*w.nHidden1 + j] * h1[j];
+            value += w.w3[k] * std::max(0.0, sum);
+        }
+        return value;
+    };
+
+    std::vector<uint64_t> boards;
+    std::unique_ptr<GameState> state(new GameState);
+    const int N_BOARDS = 40;
+    std::vector<std::unique_ptr<ConcreteGame>> games;
+    for (int b = 0; b < N_BOARDS; ++b) {
+        games.emplace_back(new ConcreteGame(b, dims));
+        ConcreteGame &game = *games.back();
+        for (int i = 0; i < b % 7 && !game.isOver(); ++i) game.drop();
+        game.snapshot(*state);
+        boards.insert(boards.end(), state->layers, state->layers + dims.z);
+    }
+
+    std::vector<ValueNetwork::Simd> simds { ValueNetwork::Simd::SCALAR };
+    if (ValueNetwork::bestSimd() != ValueNetwork::Simd::SCALAR) simds.push_back(ValueNetwork::bestSimd());
+    for (ValueNetwork::Simd simd : simds) {
+        ValueNetwork network(simd);
+        REQUIRE( !network.isLoaded() );
+        REQUIRE( network.load(path) );
+        REQUIRE( network.getInputCount() == nInputs );
+
+        std::vector<float> values(N_BOARDS);
+        network.evaluateBatch(boards.data(), N_BOARDS, values.data());
+        for (int b = 0; b < N_BOARDS; ++b) {
+            REQUIRE( values[b] == Approx(reference(&boards[b*dims.z])).margin(1e-4) );
+            // the same as single boards
+            REQUIRE( network.evaluate(&boards[b*dims.z]) == values[b] );
+            REQUIRE( network.evaluate(games[b]->getCementedBlockArray()) == values[b] );
+        }
+
+        // read in place from the block array
+        CementedBlockArray blocks((GameBox(dims)));
+        for (int b = 0; b < N_BOARDS; b += 5) {
+            std::fill(state->pieceIds, state->pieceIds + dims.x*dims.y*dims.z, 0);
+            std::copy(&boards[b*dims.z], &boards[(b + 1)*dims.z], state->layers);
+            state->dimensions = dims;
+            blocks.restoreFrom(*state);
+            REQUIRE( network.evaluate(blocks) == values[b] );
+        }
+    }
+
+    SECTION("invalid files") {
+        ValueNetwork network;
+        REQUIRE( !network.load("/nonexistent/value-network") );
+        REQUIRE( truncate(path, 100) == 0 );
+        REQUIRE( !network.load(path) );
+        REQUIRE( !network.isLoaded() );
+    }
+
+    unlink(path);
 }
@@ -0,0 +1,252 @@
+#include "api.hpp"
+#include "cemented-block-array.hpp"
+#include "piece-generator.hpp"
+#include "placement-generator.hpp"
+#include "work-stealing-pool.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+// Counts the board states reachable by sequences of placements, like perft
+// in chess engines, as a reproducible workload and regression check
+//
+//   ./bin/perft [--seed S] [--depth D] [--threads T] [--dims XxYxZ] [--check 0|1]
+//
+// The piece sequence of a seed does not depend on the placements so all
+// boards at depth d have the same active piece. Boards with the same cells
+// are transpositions and expanded only once, with the number of placement
+// sequences (paths) leading to them carried along. The piece ids and the
+// score do not affect the following placements and are not part of the
+// board. Placements after which the next piece does not fit end the game
+// and are counted but not expanded.
+//
+// The placements are applied with the game engine, CementedBlockArray
+// cementPiece, removeFullLayers and pieceFits, so the counts also catch
+// regressions in those. With --check 1, each one is also applied with the
+// bit mask versions in PlacementGenerator, place and fits, and the tool
+// aborts if they disagree.
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+    typedef std::vector<LayerMask> Board;
+
+    struct BoardHash {
+        std::size_t operator()(const Board &board) const {
+            uint64_t h = 0x9e3779b97f4a7c15ull;
+            for (LayerMask layer : board) {
+                h ^= layer + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+            }
+            return static_cast<std::size_t>(h ^ (h >> 32));
+        }
+    };
+
+    struct Options {
+        unsigned int seed = 0;
+        int depth = 2;
+        int nThreads = 0;
+        Pos3d dimensions { 5, 4, 14 };
+        bool check = false;
+    };
+
+    // the distinct boards of one depth, sharded to reduce lock contention
+    class TranspositionTable {
+    private:
+        static const int N_SHARDS = 64;
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<Board, uint64_t, BoardHash> paths;
+        };
+        Shard shards[N_SHARDS];
+    public:
+        // returns true if the board was new
+        bool add(const Board &board, uint64_t nPaths) {
+            Shard &shard = shards[BoardHash()(board) % N_SHARDS];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            uint64_t &count = shard.paths[board];
+            const bool isNew = count == 0;
+            count += nPaths;
+            return isNew;
+        }
+
+        std::vector< std::pair<Board, uint64_t> > entries() {
+            std::vector< std::pair<Board, uint64_t> > result;
+            for (Shard &shard : shards) {
+                result.insert(result.end(), shard.paths.begin(), shard.paths.end());
+                shard.paths.clear();
+            }
+            return result;
+        }
+    };
+
+    struct DepthStats {
+        uint64_t nPaths = 0;
+        uint64_t nGameOverPaths = 0;
+        uint64_t nDistinct = 0;
+        uint64_t nPlacements = 0;
+        double seconds = 0;
+    };
+
+    bool parseOptions(int argc, char **argv, Options &options) {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            const char *arg = argv[i], *value = argv[i + 1];
+            if (std::strcmp(arg, "--seed") == 0) {
+                options.seed = static_cast<unsigned int>(std::strtoul(value, nullptr, 10));
+            } else if (std::strcmp(arg, "--depth") == 0) {
+                options.depth = std::atoi(value);
+                if (options.depth <= 0) return false;
+            } else if (std::strcmp(arg, "--threads") == 0) {
+                options.nThreads = std::atoi(value);
+            } else if (std::strcmp(arg, "--dims") == 0) {
+                Pos3d &d = options.dimensions;
+                if (std::sscanf(value, "%dx%dx%d", &d.x, &d.y, &d.z) != 3) return false;
+                if (!GameState::isSupported(d)) return false;
+            } else if (std::strcmp(arg, "--check") == 0) {
+                options.check = std::atoi(value) != 0;
+            } else {
+                return false;
+            }
+        }
+        return argc % 2 == 1;
+    }
+
+    class Expander {
+    private:
+        const GameBox gameBox;
+        const bool check;
+        CementedBlockArray blocks;
+        PlacementGenerator generator;
+        std::unique_ptr<GameState> parent, child;
+        Board checkBoard;
+
+    public:
+        Expander(Pos3d dims, bool check)
+        :
+            gameBox(dims),
+            check(check),
+            blocks(gameBox),
+            generator(dims),
+            parent(new GameState()),
+            child(new GameState()),
+            checkBoard(dims.z)
+        {}
+
+        // all children of the board with the given active and next pieces
+        void expand(const Board &board, uint64_t nPaths, const Piece &active, const Piece &next,
+            TranspositionTable &table, DepthStats &stats)
+        {
+            const Pos3d dims = gameBox.dims;
+            parent->dimensions = dims;
+            std::copy(board.begin(), board.end(), parent->layers);
+            std::fill(parent->pieceIds, parent->pieceIds + dims.x*dims.y*dims.z, 0);
+            parent->activeShape = active.getShape();
+            parent->activeCenter = active.getCenter();
+            parent->activePieceId = 0;
+            parent->alive = true;
+
+            Board childBoard(dims.z);
+            for (const Placement &p : generator.generate(*parent)) {
+                blocks.restoreFrom(*parent);
+                blocks.cementPiece(Piece(p.center, p.shape, 0));
+                blocks.removeFullLayers();
+                stats.nPlacements++;
+
+                const bool fits = blocks.pieceFits(next);
+                if (check) crossCheck(board, p, next, fits);
+                if (!fits) {
+                    stats.nGameOverPaths += nPaths;
+                    continue;
+                }
+                blocks.saveTo(*child);
+                std::copy(child->layers, child->layers + dims.z, childBoard.begin());
+                if (table.add(childBoard, nPaths)) stats.nDistinct++;
+                stats.nPaths += nPaths;
+            }
+        }
+
+    private:
+        // the same placement with PlacementGenerator, against the engine
+        // result in blocks
+        void crossCheck(const Board &board, const Placement &p, const Piece &next, bool fits) {
+            std::copy(board.begin(), board.end(), checkBoard.begin());
+            generator.place(p, checkBoard.data());
+            const bool sameBoard = std::equal(checkBoard.begin(), checkBoard.end(), blocks.getLayers());
+            if (sameBoard && generator.fits(checkBoard.data(), next.getShape(), next.getCenter()) == fits) return;
+            std::fprintf(stderr, "mismatch: shape %d at (%d, %d, %d), %s\n", p.shape,
+                p.center.x, p.center.y, p.center.z, sameBoard ? "next piece fit" : "board");
+            std::abort();
+        }
+    };
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--seed S] [--depth D] [--threads T] [--dims XxYxZ] [--check 0|1]\n", argv[0]);
+        return 1;
+    }
+
+    const Pos3d dims = options.dimensions;
+    const GameBox gameBox(dims);
+    PieceGenerator pieceGenerator(gameBox, options.seed);
+    std::vector<Piece> pieces;
+    for (int i = 0; i <= options.depth; ++i) pieces.push_back(pieceGenerator.nextPiece());
+
+    WorkStealingPool pool(options.nThreads);
+    std::printf("perft seed %u, dims %dx%dx%d, %d threads%s\n", options.seed,
+        dims.x, dims.y, dims.z, pool.getThreadCount(), options.check ? ", cross-checked" : "");
+    std::printf("%5s %16s %12s %16s %10s %14s\n",
+        "depth", "paths", "distinct", "game-over", "seconds", "placements/s");
+
+    std::vector< std::pair<Board, uint64_t> > level { { Board(dims.z, 0), 1 } };
+    uint64_t nPlacementsTotal = 0;
+    const auto start = Clock::now();
+
+    for (int depth = 1; depth <= options.depth && !level.empty(); ++depth) {
+        const auto levelStart = Clock::now();
+        TranspositionTable table;
+        const int CHUNK = 16;
+        const int nChunks = (static_cast<int>(level.size()) + CHUNK - 1) / CHUNK;
+        std::vector<DepthStats> chunkStats(nChunks);
+
+        {
+            TaskGroup tasks(pool);
+            for (int c = 0; c < nChunks; ++c) {
+                tasks.run([&, c]() {
+                    Expander expander(dims, options.check);
+                    const std::size_t end = std::min(level.size(), static_cast<std::size_t>(c + 1)*CHUNK);
+                    for (std::size_t i = c*CHUNK; i < end; ++i) {
+                        expander.expand(level[i].first, level[i].second,
+                            pieces[depth - 1], pieces[depth], table, chunkStats[c]);
+                    }
+                });
+            }
+            tasks.wait();
+        }
+
+        DepthStats stats;
+        for (const DepthStats &s : chunkStats) {
+            stats.nPaths += s.nPaths;
+            stats.nGameOverPaths += s.nGameOverPaths;
+            stats.nDistinct += s.nDistinct;
+            stats.nPlacements += s.nPlacements;
+        }
+        stats.seconds = std::chrono::duration<double>(Clock::now() - levelStart).count();
+        nPlacementsTotal += stats.nPlacements;
+
+        std::printf("%5d %16llu %12llu %16llu %10.3f %14.0f\n", depth,
+            static_cast<unsigned long long>(stats.nPaths),
+            static_cast<unsigned long long>(stats.nDistinct),
+            static_cast<unsigned long long>(stats.nGameOverPaths),
+            stats.seconds, stats.nPlacements / std::max(stats.seconds, 1e-9));
+        std::fflush(stdout);
+
+        level = table.entries();
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::printf("total %.3f s, %.0f placements/s\n", seconds, nPlacementsTotal / seconds);
+    return 0;
+}
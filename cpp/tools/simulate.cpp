@@ -0,0 +1,288 @@
+#include "api.hpp"
+#include "autoplayer.hpp"
+#include "work-stealing-pool.hpp"
+#include "xoshiro.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Headless game farm: plays many games on all cores and reports the
+// throughput and the score distribution.
+//
+//   ./bin/simulate [--games N] [--seed S] [--threads T] [--dims XxYxZ]
+//                  [--policy none|random|autoplayer|script:COMMANDS] [--frame-ms MS]
+//                  [--max-time-s S]
+//
+// Game i uses the random seed S + i. Each simulation frame, the input policy
+// may act once and then the game time advances by MS milliseconds. With
+// --frame-ms 0, time jumps directly to the next timed event instead. The
+// game time is kept in int milliseconds, so --max-time-s is at most 1000000
+// (about 11.5 days).
+//
+// Script commands, repeated cyclically, one per frame: h/l move x -1/+1,
+// j/k move y -1/+1, x/X y/Y z/Z rotate CW/CCW, d drop, . do nothing
+//
+// The autoplayer places one piece per frame, with its beam search tasks in
+// the same thread pool as the games
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    enum class PolicyType { NONE, RANDOM, AUTOPLAYER, SCRIPTED };
+
+    // the game time limit plus one frame of at most 1e9 ms must fit in an int
+    const int MAX_TIME_S = 1000000;
+
+    struct Options {
+        int nGames = 1000;
+        unsigned int seed = 0;
+        int nThreads = 0;
+        bool customDimensions = false;
+        Pos3d dimensions { 0, 0, 0 };
+        PolicyType policy = PolicyType::RANDOM;
+        std::string script;
+        int frameMs = 100;
+        int maxTimeS = 3600;
+    };
+
+    struct GameResult {
+        int score;
+        long nTicks;
+        int timeMs;
+    };
+
+    class InputPolicy {
+    public:
+        // called once per simulation frame before the game time advances
+        virtual void act(Game &game) = 0;
+        virtual ~InputPolicy() = default;
+    };
+
+    class NoInputPolicy : public InputPolicy {
+    public:
+        void act(Game &) override {}
+    };
+
+    bool runCommand(Game &game, char command) {
+        switch (command) {
+        case 'h': return game.moveXY(-1, 0);
+        case 'l': return game.moveXY(1, 0);
+        case 'j': return game.moveXY(0, -1);
+        case 'k': return game.moveXY(0, 1);
+        case 'x': return game.rotate(Axis::X, RotationDirection::CW);
+        case 'X': return game.rotate(Axis::X, RotationDirection::CCW);
+        case 'y': return game.rotate(Axis::Y, RotationDirection::CW);
+        case 'Y': return game.rotate(Axis::Y, RotationDirection::CCW);
+        case 'z': return game.rotate(Axis::Z, RotationDirection::CW);
+        case 'Z': return game.rotate(Axis::Z, RotationDirection::CCW);
+        case 'd': game.drop(); return true;
+        default: return false;
+        }
+    }
+
+    bool isValidScript(const std::string &script) {
+        return !script.empty() &&
+            script.find_first_not_of("hljkxXyYzZd.") == std::string::npos;
+    }
+
+    class RandomPolicy : public InputPolicy {
+    private:
+        Xoshiro128 rng;
+    public:
+        explicit RandomPolicy(unsigned int seed) : rng(seed) {
+            // do not share the sequence of the piece generator
+            rng.jump();
+        }
+
+        void act(Game &game) override {
+            const char COMMANDS[] = "hljkxXyYzZd.....";
+            runCommand(game, COMMANDS[rng.nextBelow(sizeof(COMMANDS) - 1)]);
+        }
+    };
+
+    class ScriptedPolicy : public InputPolicy {
+    private:
+        const std::string &script;
+        std::size_t position;
+    public:
+        explicit ScriptedPolicy(const std::string &script) : script(script), position(0) {}
+
+        void act(Game &game) override {
+            runCommand(game, script[position]);
+            position = (position + 1) % script.size();
+        }
+    };
+
+    class AutoplayerPolicy : public InputPolicy {
+    private:
+        Autoplayer player;
+    public:
+        AutoplayerPolicy(Pos3d dims, WorkStealingPool &pool) : player(dims, pool) {}
+
+        void act(Game &game) override {
+            player.play(game);
+        }
+    };
+
+    std::unique_ptr<InputPolicy> buildPolicy(const Options &options, unsigned int seed,
+        const Game &game, WorkStealingPool &pool)
+    {
+        switch (options.policy) {
+        case PolicyType::RANDOM:
+            return std::unique_ptr<InputPolicy>(new RandomPolicy(seed));
+        case PolicyType::AUTOPLAYER:
+            return std::unique_ptr<InputPolicy>(new AutoplayerPolicy(game.getDimensions(), pool));
+        case PolicyType::SCRIPTED:
+            return std::unique_ptr<InputPolicy>(new ScriptedPolicy(options.script));
+        default:
+            return std::unique_ptr<InputPolicy>(new NoInputPolicy());
+        }
+    }
+
+    GameResult simulate(const Options &options, unsigned int seed, WorkStealingPool &pool) {
+        std::unique_ptr<Game> game = options.customDimensions
+            ? buildGame(seed, options.dimensions)
+            : buildGame(seed);
+        std::unique_ptr<InputPolicy> policy = buildPolicy(options, seed, *game, pool);
+
+        const int maxTimeMs = options.maxTimeS * 1000;
+        long nTicks = 0;
+        while (!game->isOver() && game->getTimeMs() < maxTimeMs) {
+            policy->act(*game);
+            if (options.frameMs > 0) game->tick(options.frameMs);
+            else game->advanceToNextEvent();
+            nTicks++;
+        }
+        return GameResult { game->getScore(), nTicks, game->getTimeMs() };
+    }
+
+    bool parseInt(const char *str, int &out) {
+        char *end;
+        const long value = std::strtol(str, &end, 10);
+        if (*str == '\0' || *end != '\0' || value < 0 || value > 1000000000) return false;
+        out = static_cast<int>(value);
+        return true;
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            const char *arg = argv[i];
+            if (i + 1 >= argc) return false;
+            const char *value = argv[++i];
+            int number;
+
+            if (std::strcmp(arg, "--games") == 0) {
+                if (!parseInt(value, options.nGames) || options.nGames == 0) return false;
+            } else if (std::strcmp(arg, "--seed") == 0) {
+                if (!parseInt(value, number)) return false;
+                options.seed = static_cast<unsigned int>(number);
+            } else if (std::strcmp(arg, "--threads") == 0) {
+                if (!parseInt(value, options.nThreads)) return false;
+            } else if (std::strcmp(arg, "--frame-ms") == 0) {
+                if (!parseInt(value, options.frameMs)) return false;
+            } else if (std::strcmp(arg, "--max-time-s") == 0) {
+                if (!parseInt(value, options.maxTimeS) || options.maxTimeS > MAX_TIME_S) return false;
+            } else if (std::strcmp(arg, "--dims") == 0) {
+                Pos3d &d = options.dimensions;
+                if (std::sscanf(value, "%dx%dx%d", &d.x, &d.y, &d.z) != 3) return false;
+                if (!GameState::isSupported(d)) return false;
+                options.customDimensions = true;
+            } else if (std::strcmp(arg, "--policy") == 0) {
+                if (std::strcmp(value, "none") == 0) {
+                    options.policy = PolicyType::NONE;
+                } else if (std::strcmp(value, "random") == 0) {
+                    options.policy = PolicyType::RANDOM;
+                } else if (std::strcmp(value, "autoplayer") == 0) {
+                    options.policy = PolicyType::AUTOPLAYER;
+                } else if (std::strncmp(value, "script:", 7) == 0) {
+                    options.policy = PolicyType::SCRIPTED;
+                    options.script = value + 7;
+                    if (!isValidScript(options.script)) return false;
+                } else {
+                    return false;
+                }
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const char *policyName(const Options &options) {
+        switch (options.policy) {
+        case PolicyType::NONE: return "none";
+        case PolicyType::RANDOM: return "random";
+        case PolicyType::AUTOPLAYER: return "autoplayer";
+        default: return options.script.c_str();
+        }
+    }
+
+    void printScoreDistribution(std::vector<int> scores) {
+        std::sort(scores.begin(), scores.end());
+        const std::size_t n = scores.size();
+        double sum = 0;
+        for (int s : scores) sum += s;
+
+        auto percentile = [&scores, n](int p) { return scores[(n - 1) * p / 100]; };
+        std::printf("score mean %.1f, min %d, p10 %d, median %d, p90 %d, max %d\n",
+            sum / n, scores.front(), percentile(10), percentile(50), percentile(90),
+            scores.back());
+
+        const int N_BUCKETS = 10, BAR_WIDTH = 50;
+        const int lo = scores.front();
+        const int bucketSize = std::max(1, (scores.back() - lo + N_BUCKETS) / N_BUCKETS);
+        std::vector<int> counts(N_BUCKETS, 0);
+        for (int s : scores) counts[std::min(N_BUCKETS - 1, (s - lo) / bucketSize)]++;
+        const int maxCount = *std::max_element(counts.begin(), counts.end());
+
+        for (int i = 0; i < N_BUCKETS; ++i) {
+            if (lo + i * bucketSize > scores.back()) break;
+            std::printf("%8d - %-8d %8d |%s\n", lo + i * bucketSize, lo + (i + 1) * bucketSize - 1,
+                counts[i], std::string(counts[i] * BAR_WIDTH / maxCount, '#').c_str());
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--games N] [--seed S] [--threads T] [--dims XxYxZ]\n"
+            "    [--policy none|random|autoplayer|script:COMMANDS] [--frame-ms MS] [--max-time-s S]\n", argv[0]);
+        return 1;
+    }
+
+    WorkStealingPool pool(options.nThreads);
+    std::vector<GameResult> results(options.nGames);
+
+    const auto start = Clock::now();
+    {
+        TaskGroup games(pool);
+        for (int i = 0; i < options.nGames; ++i) {
+            games.run([&options, &results, &pool, i]() {
+                results[i] = simulate(options, options.seed + i, pool);
+            });
+        }
+        games.wait();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    long nTicks = 0;
+    double gameSeconds = 0;
+    std::vector<int> scores;
+    for (const GameResult &r : results) {
+        nTicks += r.nTicks;
+        gameSeconds += r.timeMs * 1e-3;
+        scores.push_back(r.score);
+    }
+
+    std::printf("%d games, seeds %u-%u, policy %s, %d threads\n", options.nGames,
+        options.seed, options.seed + options.nGames - 1, policyName(options),
+        pool.getThreadCount());
+    std::printf("wall time %.3f s, mean game length %.1f s\n", seconds, gameSeconds / options.nGames);
+    std::printf("%.0f games/s, %.0f ticks/s\n", options.nGames / seconds, nTicks / seconds);
+    printScoreDistribution(scores);
+    return 0;
+}
@@ -0,0 +1,495 @@
+#include "autoplayer.hpp"
+#include "game.hpp"
+#include "game-config.hpp"
+#include "work-stealing-pool.hpp"
+#include "xoshiro.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <vector>
+
+// Tunes the FeatureWeights of the autoplayer with the separable CMA-ES of
+// Ros & Hansen (2008), i.e., CMA-ES with a diagonal covariance matrix.
+//
+//   ./bin/tune [--generations G] [--population L] [--games N] [--max-pieces P]
+//              [--sigma S] [--seed S] [--threads T] [--dims XxYxZ]
+//              [--checkpoint FILE]
+//
+// The fitness of a weight vector is the mean score of N games of at most P
+// pieces each, played by the greedy autoplayer (beam width 1, no
+// lookahead). All candidates of a generation play the same seeds, common
+// random numbers, so that their differences are not drowned by the
+// differences between the games. Generation g uses the seeds
+// S + g*N ... S + g*N + N - 1. The mean of the search distribution is
+// evaluated on the same games for reference.
+//
+// Every game of a generation is a task in the pool. After each generation,
+// the optimizer state is written to FILE (default tune-checkpoint.txt),
+// and an existing FILE is resumed from. The checkpoint records --population,
+// --games, --max-pieces, --dims and --seed, and the tool refuses to resume
+// it with other values or if it is not complete
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    const int N = FeatureWeights::N_WEIGHTS;
+    const double PI = 3.14159265358979323846;
+
+    const char *const WEIGHT_NAMES[N] = {
+        "holes", "aggregateHeight", "maxHeight", "bumpiness",
+        "wellDepth", "maxWellDepth", "nearFullLayers", "removedLayers"
+    };
+
+    struct Options {
+        int nGenerations = 20;
+        int population = 0;
+        int nGames = 200;
+        int maxPieces = 500;
+        double sigma = 0.5;
+        unsigned int seed = 0;
+        int nThreads = 0;
+        Pos3d dimensions = game_config::DIMENSIONS;
+        std::string checkpoint = "tune-checkpoint.txt";
+    };
+
+    struct GameResult {
+        int score;
+        int nPieces;
+    };
+
+    // plays the games of one generation, one greedy autoplayer per thread
+    class Evaluator {
+    public:
+        Evaluator(const Options &options, WorkStealingPool &pool) : options(options), pool(pool) {
+            for (int i = 0; i <= pool.getThreadCount(); ++i) {
+                players.emplace_back(new Autoplayer(options.dimensions, pool, 1, 0));
+            }
+        }
+
+        // mean scores of the candidates, on the same seeds
+        std::vector<double> evaluate(const std::vector<FeatureWeights> &candidates,
+            unsigned int firstSeed, long &nPieces)
+        {
+            const int nCandidates = static_cast<int>(candidates.size());
+            std::vector<GameResult> results(nCandidates*options.nGames);
+            {
+                TaskGroup tasks(pool);
+                for (int c = 0; c < nCandidates; ++c) {
+                    for (int g = 0; g < options.nGames; ++g) {
+                        tasks.run([&, c, g]() {
+                            results[c*options.nGames + g] = play(candidates[c], firstSeed + g);
+                        });
+                    }
+                }
+                tasks.wait();
+            }
+
+            std::vector<double> fitness(nCandidates, 0.0);
+            nPieces = 0;
+            for (int c = 0; c < nCandidates; ++c) {
+                for (int g = 0; g < options.nGames; ++g) {
+                    fitness[c] += results[c*options.nGames + g].score;
+                    nPieces += results[c*options.nGames + g].nPieces;
+                }
+                fitness[c] /= options.nGames;
+            }
+            return fitness;
+        }
+
+    private:
+        const Options &options;
+        WorkStealingPool &pool;
+        std::vector< std::unique_ptr<Autoplayer> > players;
+
+        GameResult play(const FeatureWeights &weights, unsigned int seed) {
+            const int worker = pool.getWorkerIndex();
+            Autoplayer &player = *players[worker < 0 ? pool.getThreadCount() : worker];
+            player.setWeights(weights);
+
+            ConcreteGame game(seed, options.dimensions);
+            int nPieces = 0;
+            while (nPieces < options.maxPieces && player.play(game)) nPieces++;
+            return GameResult { game.getScore(), nPieces };
+        }
+    };
+
+    // sep-CMA-ES for maximization, see Hansen, "The CMA Evolution
+    // Strategy: A Tutorial" for the parameters and Ros & Hansen,
+    // "A Simple Modification in CMA-ES Achieving Linear Time and Space
+    // Complexity" for the diagonal version
+    class SepCmaEs {
+    public:
+        int generation;
+        double sigma;
+        double mean[N];
+        // the diagonal of the covariance matrix
+        double variance[N];
+        double sigmaPath[N], covariancePath[N];
+        Xoshiro128 random;
+
+        SepCmaEs(int lambda, const FeatureWeights &start, double sigma0, unsigned int seed)
+        :
+            generation(0),
+            sigma(sigma0),
+            random(seed),
+            lambda(lambda),
+            mu(lambda / 2)
+        {
+            for (int i = 0; i < N; ++i) {
+                mean[i] = start[i];
+                variance[i] = 1.0;
+                sigmaPath[i] = covariancePath[i] = 0.0;
+            }
+
+            for (int i = 0; i < mu; ++i) recombination.push_back(std::log(mu + 0.5) - std::log(i + 1.0));
+            const double sum = std::accumulate(recombination.begin(), recombination.end(), 0.0);
+            double sumSquares = 0;
+            for (double &r : recombination) {
+                r /= sum;
+                sumSquares += r*r;
+            }
+            muEff = 1.0 / sumSquares;
+
+            cSigma = (muEff + 2) / (N + muEff + 5);
+            dSigma = 1 + 2*std::max(0.0, std::sqrt((muEff - 1) / (N + 1)) - 1) + cSigma;
+            cC = (4 + muEff/N) / (N + 4 + 2*muEff/N);
+            // the diagonal covariance learns (N + 2)/3 times faster
+            const double speedup = (N + 2) / 3.0;
+            c1 = std::min(1.0, speedup * 2 / ((N + 1.3)*(N + 1.3) + muEff));
+            cMu = std::min(1 - c1, speedup * 2*(muEff - 2 + 1/muEff) / ((N + 2)*(N + 2) + muEff));
+            expectedNorm = std::sqrt(double(N)) * (1 - 1.0/(4*N) + 1.0/(21*N*N));
+        }
+
+        // new candidates, keeping their steps (x - mean) / sigma for update
+        std::vector<FeatureWeights> sample() {
+            steps.assign(lambda*N, 0.0);
+            std::vector<FeatureWeights> candidates(lambda);
+            for (int k = 0; k < lambda; ++k) {
+                for (int i = 0; i < N; ++i) {
+                    const double y = std::sqrt(variance[i]) * normal();
+                    steps[k*N + i] = y;
+                    candidates[k][i] = mean[i] + sigma*y;
+                }
+            }
+            return candidates;
+        }
+
+        void update(const std::vector<double> &fitness) {
+            std::vector<int> order(lambda);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&fitness](int a, int b) {
+                return fitness[a] > fitness[b];
+            });
+
+            double meanStep[N] = {};
+            for (int r = 0; r < mu; ++r) {
+                for (int i = 0; i < N; ++i) meanStep[i] += recombination[r] * steps[order[r]*N + i];
+            }
+
+            double pathNorm = 0;
+            for (int i = 0; i < N; ++i) {
+                mean[i] += sigma*meanStep[i];
+                sigmaPath[i] = (1 - cSigma)*sigmaPath[i] +
+                    std::sqrt(cSigma*(2 - cSigma)*muEff) * meanStep[i] / std::sqrt(variance[i]);
+                pathNorm += sigmaPath[i]*sigmaPath[i];
+            }
+            pathNorm = std::sqrt(pathNorm);
+
+            // stall the covariance path while the step size grows fast
+            const double hSigma = pathNorm / std::sqrt(1 - std::pow(1 - cSigma, 2.0*(generation + 1)))
+                < (1.4 + 2.0/(N + 1)) * expectedNorm ? 1.0 : 0.0;
+
+            for (int i = 0; i < N; ++i) {
+                covariancePath[i] = (1 - cC)*covariancePath[i] +
+                    hSigma * std::sqrt(cC*(2 - cC)*muEff) * meanStep[i];
+                double rankMu = 0;
+                for (int r = 0; r < mu; ++r) {
+                    const double y = steps[order[r]*N + i];
+                    rankMu += recombination[r] * y*y;
+                }
+                variance[i] = (1 - c1 - cMu)*variance[i] +
+                    c1*(covariancePath[i]*covariancePath[i] + (1 - hSigma)*cC*(2 - cC)*variance[i]) +
+                    cMu*rankMu;
+            }
+
+            sigma *= std::exp(cSigma/dSigma * (pathNorm/expectedNorm - 1));
+            generation++;
+        }
+
+        FeatureWeights getMean() const {
+            FeatureWeights w;
+            for (int i = 0; i < N; ++i) w[i] = mean[i];
+            return w;
+        }
+
+    private:
+        const int lambda, mu;
+        std::vector<double> recombination;
+        double muEff, cSigma, dSigma, cC, c1, cMu, expectedNorm;
+        std::vector<double> steps;
+
+        // Box-Muller with uniforms in (0, 1]
+        double normal() {
+            const double u1 = (random.next() + 1.0) / 4294967296.0;
+            const double u2 = random.next() / 4294967296.0;
+            return std::sqrt(-2*std::log(u1)) * std::cos(2*PI*u2);
+        }
+    };
+
+    // the options a checkpoint is only valid for, the rest may change
+    // between runs
+    struct RunOptions {
+        int population;
+        int nGames;
+        int maxPieces;
+        Pos3d dimensions;
+        unsigned int seed;
+
+        bool operator==(const RunOptions &o) const {
+            return population == o.population && nGames == o.nGames && maxPieces == o.maxPieces &&
+                dimensions.x == o.dimensions.x && dimensions.y == o.dimensions.y &&
+                dimensions.z == o.dimensions.z && seed == o.seed;
+        }
+    };
+
+    // optimizer state, as in the checkpoint
+    struct Checkpoint {
+        RunOptions options;
+        int generation;
+        double sigma;
+        double mean[N], variance[N], sigmaPath[N], covariancePath[N];
+        uint32_t random[Xoshiro128::STATE_SIZE];
+        double best[N];
+        double bestFitness;
+    };
+
+    enum class LoadResult { MISSING, LOADED, CORRUPT };
+
+    // the checkpoint is a text file of "name value..." lines, written to a
+    // temporary file first so that an interrupted write keeps the old one
+    bool saveCheckpoint(const std::string &path, const Checkpoint &c) {
+        const std::string tmp = path + ".tmp";
+        FILE *f = std::fopen(tmp.c_str(), "w");
+        if (!f) return false;
+
+        auto writeArray = [f](const char *name, const double *values) {
+            std::fprintf(f, "%s", name);
+            for (int i = 0; i < N; ++i) std::fprintf(f, " %.17g", values[i]);
+            std::fprintf(f, "\n");
+        };
+        const RunOptions &o = c.options;
+        std::fprintf(f, "population %d\n", o.population);
+        std::fprintf(f, "games %d\n", o.nGames);
+        std::fprintf(f, "maxPieces %d\n", o.maxPieces);
+        std::fprintf(f, "dims %d %d %d\n", o.dimensions.x, o.dimensions.y, o.dimensions.z);
+        std::fprintf(f, "seed %u\n", o.seed);
+        std::fprintf(f, "generation %d\n", c.generation);
+        std::fprintf(f, "sigma %.17g\n", c.sigma);
+        writeArray("mean", c.mean);
+        writeArray("variance", c.variance);
+        writeArray("sigmaPath", c.sigmaPath);
+        writeArray("covariancePath", c.covariancePath);
+        std::fprintf(f, "random %u %u %u %u\n", c.random[0], c.random[1], c.random[2], c.random[3]);
+        writeArray("best", c.best);
+        std::fprintf(f, "bestFitness %.17g\n", c.bestFitness);
+        std::fprintf(f, "end\n");
+
+        const bool ok = std::fclose(f) == 0;
+        return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    // reads the whole file into c, which is only meaningful if LOADED
+    LoadResult loadCheckpoint(const std::string &path, Checkpoint &c) {
+        FILE *f = std::fopen(path.c_str(), "r");
+        if (!f) return LoadResult::MISSING;
+
+        auto label = [f](const char *name) {
+            char read[32];
+            return std::fscanf(f, "%31s", read) == 1 && std::strcmp(read, name) == 0;
+        };
+        auto readArray = [f, &label](const char *name, double *values) {
+            if (!label(name)) return false;
+            for (int i = 0; i < N; ++i) {
+                if (std::fscanf(f, "%lf", &values[i]) != 1 || !std::isfinite(values[i])) return false;
+            }
+            return true;
+        };
+        RunOptions &o = c.options;
+        bool ok =
+            label("population") && std::fscanf(f, "%d", &o.population) == 1 &&
+            label("games") && std::fscanf(f, "%d", &o.nGames) == 1 &&
+            label("maxPieces") && std::fscanf(f, "%d", &o.maxPieces) == 1 &&
+            label("dims") && std::fscanf(f, "%d %d %d", &o.dimensions.x, &o.dimensions.y, &o.dimensions.z) == 3 &&
+            label("seed") && std::fscanf(f, "%u", &o.seed) == 1 &&
+            label("generation") && std::fscanf(f, "%d", &c.generation) == 1 &&
+            label("sigma") && std::fscanf(f, "%lf", &c.sigma) == 1 &&
+            readArray("mean", c.mean) &&
+            readArray("variance", c.variance) &&
+            readArray("sigmaPath", c.sigmaPath) &&
+            readArray("covariancePath", c.covariancePath) &&
+            label("random") &&
+            std::fscanf(f, "%u %u %u %u", &c.random[0], &c.random[1], &c.random[2], &c.random[3]) == 4 &&
+            readArray("best", c.best) &&
+            label("bestFitness") && std::fscanf(f, "%lf", &c.bestFitness) == 1 &&
+            // a truncated file does not have the last line
+            label("end");
+        std::fclose(f);
+
+        ok = ok && c.generation >= 0 && std::isfinite(c.sigma) && c.sigma > 0 &&
+            (c.random[0] | c.random[1] | c.random[2] | c.random[3]) != 0;
+        for (int i = 0; ok && i < N; ++i) ok = c.variance[i] > 0;
+        return ok ? LoadResult::LOADED : LoadResult::CORRUPT;
+    }
+
+    void printWeights(const FeatureWeights &weights) {
+        for (int i = 0; i < N; ++i) std::printf("    %s = %.4f;\n", WEIGHT_NAMES[i], weights[i]);
+    }
+
+    bool parseInt(const char *str, int &out) {
+        char *end;
+        const long value = std::strtol(str, &end, 10);
+        if (*str == '\0' || *end != '\0' || value < 0 || value > 1000000000) return false;
+        out = static_cast<int>(value);
+        return true;
+    }
+
+    bool parseOptions(int argc, char **argv, Options &options) {
+        for (int i = 1; i < argc; ++i) {
+            const char *arg = argv[i];
+            if (i + 1 >= argc) return false;
+            const char *value = argv[++i];
+            int number;
+
+            if (std::strcmp(arg, "--generations") == 0) {
+                if (!parseInt(value, options.nGenerations)) return false;
+            } else if (std::strcmp(arg, "--population") == 0) {
+                if (!parseInt(value, options.population) || options.population == 1) return false;
+            } else if (std::strcmp(arg, "--games") == 0) {
+                if (!parseInt(value, options.nGames) || options.nGames == 0) return false;
+            } else if (std::strcmp(arg, "--max-pieces") == 0) {
+                if (!parseInt(value, options.maxPieces) || options.maxPieces == 0) return false;
+            } else if (std::strcmp(arg, "--sigma") == 0) {
+                char *end;
+                options.sigma = std::strtod(value, &end);
+                if (*end != '\0' || !(options.sigma > 0)) return false;
+            } else if (std::strcmp(arg, "--seed") == 0) {
+                if (!parseInt(value, number)) return false;
+                options.seed = static_cast<unsigned int>(number);
+            } else if (std::strcmp(arg, "--threads") == 0) {
+                if (!parseInt(value, options.nThreads)) return false;
+            } else if (std::strcmp(arg, "--dims") == 0) {
+                Pos3d &d = options.dimensions;
+                if (std::sscanf(value, "%dx%dx%d", &d.x, &d.y, &d.z) != 3) return false;
+                if (!GameState::isSupported(d)) return false;
+            } else if (std::strcmp(arg, "--checkpoint") == 0) {
+                options.checkpoint = value;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr, "usage: %s [--generations G] [--population L] [--games N] [--max-pieces P]\n"
+            "    [--sigma S] [--seed S] [--threads T] [--dims XxYxZ] [--checkpoint FILE]\n", argv[0]);
+        return 1;
+    }
+
+    // the default population size of CMA-ES
+    const int lambda = options.population > 0 ? options.population : 4 + int(3*std::log(double(N)));
+    SepCmaEs es(lambda, FeatureWeights(), options.sigma, options.seed);
+    FeatureWeights best;
+    double bestFitness = -1;
+    const RunOptions runOptions { lambda, options.nGames, options.maxPieces, options.dimensions, options.seed };
+
+    // refuse to overwrite a checkpoint that cannot be resumed
+    Checkpoint checkpoint;
+    switch (loadCheckpoint(options.checkpoint, checkpoint)) {
+    case LoadResult::MISSING:
+        break;
+    case LoadResult::CORRUPT:
+        std::fprintf(stderr, "%s is not a valid checkpoint\n", options.checkpoint.c_str());
+        return 1;
+    case LoadResult::LOADED:
+        if (!(checkpoint.options == runOptions)) {
+            const RunOptions &o = checkpoint.options;
+            std::fprintf(stderr, "%s is for other options: --population %d --games %d "
+                "--max-pieces %d --dims %dx%dx%d --seed %u\n", options.checkpoint.c_str(),
+                o.population, o.nGames, o.maxPieces, o.dimensions.x, o.dimensions.y,
+                o.dimensions.z, o.seed);
+            return 1;
+        }
+        es.generation = checkpoint.generation;
+        es.sigma = checkpoint.sigma;
+        std::copy(checkpoint.mean, checkpoint.mean + N, es.mean);
+        std::copy(checkpoint.variance, checkpoint.variance + N, es.variance);
+        std::copy(checkpoint.sigmaPath, checkpoint.sigmaPath + N, es.sigmaPath);
+        std::copy(checkpoint.covariancePath, checkpoint.covariancePath + N, es.covariancePath);
+        es.random.setState(checkpoint.random);
+        for (int i = 0; i < N; ++i) best[i] = checkpoint.best[i];
+        bestFitness = checkpoint.bestFitness;
+        std::printf("resuming from %s at generation %d\n", options.checkpoint.c_str(), es.generation);
+        break;
+    }
+
+    WorkStealingPool pool(options.nThreads);
+    Evaluator evaluator(options, pool);
+    std::printf("sep-CMA-ES, population %d, %d games of at most %d pieces per candidate, %d threads\n",
+        lambda, options.nGames, options.maxPieces, pool.getThreadCount());
+
+    while (es.generation < options.nGenerations) {
+        const auto start = Clock::now();
+        const unsigned int firstSeed = options.seed + es.generation*options.nGames;
+
+        // the candidates and then the mean, all on the same games
+        std::vector<FeatureWeights> candidates = es.sample();
+        candidates.push_back(es.getMean());
+        long nPieces;
+        std::vector<double> fitness = evaluator.evaluate(candidates, firstSeed, nPieces);
+        const double meanFitness = fitness.back();
+        candidates.pop_back();
+        fitness.pop_back();
+
+        const int top = static_cast<int>(std::max_element(fitness.begin(), fitness.end()) - fitness.begin());
+        // the best over all generations, judged on its own games
+        if (meanFitness > bestFitness) {
+            bestFitness = meanFitness;
+            best = es.getMean();
+        }
+        es.update(fitness);
+
+        const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::printf("generation %d: mean %.1f, best candidate %.1f, sigma %.3f, %.1f s, %.0f pieces/s\n",
+            es.generation, meanFitness, fitness[top], es.sigma, seconds, nPieces / seconds);
+        std::fflush(stdout);
+
+        checkpoint.options = runOptions;
+        checkpoint.generation = es.generation;
+        checkpoint.sigma = es.sigma;
+        std::copy(es.mean, es.mean + N, checkpoint.mean);
+        std::copy(es.variance, es.variance + N, checkpoint.variance);
+        std::copy(es.sigmaPath, es.sigmaPath + N, checkpoint.sigmaPath);
+        std::copy(es.covariancePath, es.covariancePath + N, checkpoint.covariancePath);
+        es.random.getState(checkpoint.random);
+        for (int i = 0; i < N; ++i) checkpoint.best[i] = best[i];
+        checkpoint.bestFitness = bestFitness;
+        if (!saveCheckpoint(options.checkpoint, checkpoint)) {
+            std::fprintf(stderr, "could not write %s\n", options.checkpoint.c_str());
+            return 1;
+        }
+    }
+
+    std::printf("best mean %.1f with\n", bestFitness);
+    printWeights(best);
+    return 0;
+}